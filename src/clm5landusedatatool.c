@@ -8,11 +8,22 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <netcdf.h>
 #include <fcntl.h>
 #include <math.h>
 #include <string.h>
 #include <ctype.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#ifdef USEMPI
+#include <mpi.h>
+#include <netcdf_par.h>
+#endif
 
 #define MAXCLMPIX 1440
 #define MAXCLMLIN 720
@@ -33,6 +44,7 @@
 
 #define RANK_natpft 1
 #define RANK_cft 1
+#define RANK_YEAR 1
 #define RANK_EDGEN 0
 #define RANK_EDGEE 0
 #define RANK_EDGES 0
@@ -66,6 +78,8 @@ long MAXOUTPIX = MAXCLMPIX;
 long MAXOUTLIN = MAXCLMLIN;
 long OUTLONOFFSET = 0;
 long OUTLATOFFSET = 0;
+long OUTSOUTHLATOFFSET = 0;
+long OUTBANDLATOFFSET = 0;
 float OUTPIXSIZE = CLMPIXSIZE;
 float OUTLLX = CLMLLX;
 float OUTLLY = CLMLLY;
@@ -73,6 +87,32 @@ float OUTLLY = CLMLLY;
 long OUTDATASIZE = sizeof(float) * MAXCLMPIX * MAXCLMLIN;
 long OUTDBLDATASIZE = sizeof(double) * MAXCLMPIX * MAXCLMLIN;
 
+/* Distance between two pixels of one type in the PFT, CFT and raw CFT blocks - 1 for plane major blocks of whole */
+/* grids, the type count for pixel major blocks where the types of a pixel sit next to each other */
+
+long PFTPIXSTEP = 1;
+long CFTPIXSTEP = 1;
+long CFTRAWPIXSTEP = 1;
+
+/* Largest scratch a pixel major block read transposes through - a band of rows of every type, outside the arenas */
+
+#define TRANSPOSEBANDBYTES (4 * 1024 * 1024)
+
+/* MPI rank of this process and number of ranks - a serial build is rank 0 of 1 */
+
+int mpirank = 0;
+int mpisize = 1;
+
+/* Tiles - the region is generated one block of rows at a time, each tile split into one band of BANDLIN rows per rank */
+
+long BANDLIN;
+long TILELIN;
+int tilecount = 1;
+int currenttile = 0;
+long REGIONLATOFFSET;
+long REGIONSOUTHLATOFFSET;
+char referencecacheroot[1024];
+
 /* Namelist Variables */
 
 char regionfilename[1024];
@@ -103,15 +143,26 @@ char cftrawparamfile[1024];
 char cftparamfile[1024];
 int flipLUHgrids;
 int includeOcean;
+int outputdeflate = 1;
+int outputshuffle = 1;
+long outputchunktype = 1;
+long outputchunklat = 0;
+long outputchunklon = 0;
+int yearthreads = 1;
+char referencecache[1024] = "none";
+int outputtimeseries = 0;
+long maxmemory = 0;
+int pixelmajorgrids = 0;
+int kernelthreads = 1;
+int unrepresentedlulcc = 0;
+int enabledstages;
 
 char PFTluhtype[MAXPFT][256];
 char CFTRAWluhtype[MAXCFTRAW][256];
 char CFTluhtype[MAXCFT][256];
 
 float *tempGrid;
-float *tempflipGrid;
-float *tempoutGrid;
-float *translossGrid;
+float *zeroGrid;
 
 int *innatpft;
 int *incft;
@@ -159,128 +210,478 @@ float *inBASEC4PERGrid;
 float *inBASEC3NFXGrid;
 float *inBASEURBANGrid;
 
-float *inCURRPRIMFGrid;
-float *inCURRPRIMNGrid;
-float *inCURRSECDFGrid;
-float *inCURRSECDNGrid;
-float *inCURRPASTRGrid;
-float *inCURRRANGEGrid;
-float *inCURRC3ANNGrid;
-float *inCURRC4ANNGrid;
-float *inCURRC3PERGrid;
-float *inCURRC4PERGrid;
-float *inCURRC3NFXGrid;
-float *inCURRURBANGrid;
-
-float *inPREVSECDFGrid;
-float *inPREVSECDNGrid;
-float *inPREVPASTRGrid;
-float *inPREVRANGEGrid;
-float *inPREVC3ANNGrid;
-float *inPREVC4ANNGrid;
-float *inPREVC3PERGrid;
-float *inPREVC4PERGrid;
-float *inPREVC3NFXGrid;
-
-float *inHARVESTVH1Grid;
-float *inHARVESTVH2Grid;
-float *inHARVESTSH1Grid;
-float *inHARVESTSH2Grid;
-float *inHARVESTSH3Grid;
-
-float *inBIOHVH1Grid;
-float *inBIOHVH2Grid;
-float *inBIOHSH1Grid;
-float *inBIOHSH2Grid;
-float *inBIOHSH3Grid;
-
-float *inUNREPSECDFGrid;
-float *inUNREPSECDNGrid;
-float *inUNREPPASTRGrid;
-float *inUNREPRANGEGrid;
-float *inUNREPC3ANNGrid;
-float *inUNREPC4ANNGrid;
-float *inUNREPC3PERGrid;
-float *inUNREPC4PERGrid;
-float *inUNREPC3NFXGrid;
-
-float *inFERTC3ANNGrid;
-float *inFERTC4ANNGrid;
-float *inFERTC3PERGrid;
-float *inFERTC4PERGrid;
-float *inFERTC3NFXGrid;
-
-float *inIRRIGC3ANNGrid;
-float *inIRRIGC4ANNGrid;
-float *inIRRIGC3PERGrid;
-float *inIRRIGC4PERGrid;
-float *inIRRIGC3NFXGrid;
-
-float *inBASEFORESTTOTALGrid;
-float *inBASENONFORESTTOTALGrid;
-float *inBASECROPTOTALGrid;
-float *inBASEMISSINGGrid;
-float *inBASEOTHERGrid;
-float *inBASENATVEGGrid;
-
-float *inCURRFORESTTOTALGrid;
-float *inCURRNONFORESTTOTALGrid;
-float *inCURRCROPTOTALGrid;
-float *inCURRMISSINGGrid;
-float *inCURROTHERGrid;
-float *inCURRNATVEGGrid;
-
-float *inUNREPFORESTGrid;
-float *inUNREPOTHERGrid;
-
-float *outPCTNATVEGGrid;
-float *outPCTCROPGrid;
-float *outPCTPFTGrid[MAXPFT];
-float *outPCTCFTGrid[MAXCFT];
-
-float *outFERTNITROGrid[MAXCFT];
-
-float *outUNREPPFTGrid[MAXPFT];
-float *outUNREPCFTGrid[MAXCFT];
-
-float *outHARVESTVH1Grid;
-float *outHARVESTVH2Grid;
-float *outHARVESTSH1Grid;
-float *outHARVESTSH2Grid;
-float *outHARVESTSH3Grid;
-
-float *outBIOHVH1Grid;
-float *outBIOHVH2Grid;
-float *outBIOHSH1Grid;
-float *outBIOHSH2Grid;
-float *outBIOHSH3Grid;
-
-double *outLANDFRACdblGrid;
-double *outAREAdblGrid;
-double *outPCTGLACIERdblGrid;
-double *outPCTLAKEdblGrid;
-double *outPCTWETLANDdblGrid;
-double *outPCTURBANdblGrid;
-
-double *outPCTNATVEGdblGrid;
-double *outPCTCROPdblGrid;
-double *outPCTPFTdblGrid[MAXPFT];
-double *outPCTCFTdblGrid[MAXCFT];
-
-double *outFERTNITROdblGrid[MAXCFT];
-
-double *outUNREPPFTdblGrid[MAXPFT];
-double *outUNREPCFTdblGrid[MAXCFT];
-
-double *outBIOHVH1dblGrid;
-double *outBIOHVH2dblGrid;
-double *outBIOHSH1dblGrid;
-double *outBIOHSH2dblGrid;
-double *outBIOHSH3dblGrid;
+/* Land index - the region index of every LANDMASK pixel of the tile in row order, the year kernels only visit these */
+/* pixels and the year context and output set grids hold them packed in this land order */
+
+long *landpixindex;
+long landpixcount = 0;
+
+/* Per year grids - thread local so each year worker and kernel thread points them at its own kernel scratch and grid sets */
+
+__thread float *inCURRPRIMFGrid;
+__thread float *inCURRPRIMNGrid;
+__thread float *inCURRSECDFGrid;
+__thread float *inCURRSECDNGrid;
+__thread float *inCURRPASTRGrid;
+__thread float *inCURRRANGEGrid;
+__thread float *inCURRC3ANNGrid;
+__thread float *inCURRC4ANNGrid;
+__thread float *inCURRC3PERGrid;
+__thread float *inCURRC4PERGrid;
+__thread float *inCURRC3NFXGrid;
+__thread float *inCURRURBANGrid;
+
+__thread float *inPREVSECDFGrid;
+__thread float *inPREVSECDNGrid;
+__thread float *inPREVPASTRGrid;
+__thread float *inPREVRANGEGrid;
+__thread float *inPREVC3ANNGrid;
+__thread float *inPREVC4ANNGrid;
+__thread float *inPREVC3PERGrid;
+__thread float *inPREVC4PERGrid;
+__thread float *inPREVC3NFXGrid;
+
+__thread float *inHARVESTVH1Grid;
+__thread float *inHARVESTVH2Grid;
+__thread float *inHARVESTSH1Grid;
+__thread float *inHARVESTSH2Grid;
+__thread float *inHARVESTSH3Grid;
+
+__thread float *inBIOHVH1Grid;
+__thread float *inBIOHVH2Grid;
+__thread float *inBIOHSH1Grid;
+__thread float *inBIOHSH2Grid;
+__thread float *inBIOHSH3Grid;
+
+__thread float *inUNREPSECDFGrid;
+__thread float *inUNREPSECDNGrid;
+__thread float *inUNREPPASTRGrid;
+__thread float *inUNREPRANGEGrid;
+__thread float *inUNREPC3ANNGrid;
+__thread float *inUNREPC4ANNGrid;
+__thread float *inUNREPC3PERGrid;
+__thread float *inUNREPC4PERGrid;
+__thread float *inUNREPC3NFXGrid;
+
+__thread float *inFERTC3ANNGrid;
+__thread float *inFERTC4ANNGrid;
+__thread float *inFERTC3PERGrid;
+__thread float *inFERTC4PERGrid;
+__thread float *inFERTC3NFXGrid;
+
+__thread float *inIRRIGC3ANNGrid;
+__thread float *inIRRIGC4ANNGrid;
+__thread float *inIRRIGC3PERGrid;
+__thread float *inIRRIGC4PERGrid;
+__thread float *inIRRIGC3NFXGrid;
+
+/* the intermediate grids are each thread's own kernel scratch - one block of KERNELBLOCKLAND land pixels */
+
+__thread float *inBASEFORESTTOTALGrid;
+__thread float *inBASENONFORESTTOTALGrid;
+__thread float *inBASECROPTOTALGrid;
+__thread float *inBASEMISSINGGrid;
+__thread float *inBASEOTHERGrid;
+__thread float *inBASENATVEGGrid;
+
+__thread float *inCURRFORESTTOTALGrid;
+__thread float *inCURRNONFORESTTOTALGrid;
+__thread float *inCURRCROPTOTALGrid;
+__thread float *inCURRMISSINGGrid;
+__thread float *inCURROTHERGrid;
+__thread float *inCURRNATVEGGrid;
+
+__thread float *inUNREPFORESTGrid;
+__thread float *inUNREPOTHERGrid;
+
+__thread float *outPCTNATVEGGrid;
+__thread float *outPCTCROPGrid;
+__thread float *outPCTPFTGrid[MAXPFT];
+__thread float *outPCTCFTGrid[MAXCFT];
+
+__thread float *outFERTNITROGrid[MAXCFT];
+
+__thread float *outUNREPPFTGrid[MAXPFT];
+__thread float *outUNREPCFTGrid[MAXCFT];
+
+__thread float *outHARVESTVH1Grid;
+__thread float *outHARVESTVH2Grid;
+__thread float *outHARVESTSH1Grid;
+__thread float *outHARVESTSH2Grid;
+__thread float *outHARVESTSH3Grid;
+
+__thread float *outBIOHVH1Grid;
+__thread float *outBIOHVH2Grid;
+__thread float *outBIOHSH1Grid;
+__thread float *outBIOHSH2Grid;
+__thread float *outBIOHSH3Grid;
+
+/* Year contexts - the team of kernelthreads - 1 kernel threads that help one year worker compute its year - a year's */
+/* land index is cut into chunks of equal land pixel counts that the worker and its kernel threads claim in turn until */
+/* none are left, and every thread runs all the kernels over its chunk one block of KERNELBLOCKLAND pixels at a time */
+
+#define KERNELCHUNKSPERTHREAD 16
+#define KERNELBLOCKLAND 1024
+
+typedef struct {
+  pthread_t *kernelthreadids;
+  pthread_mutex_t kernelmutex;
+  pthread_cond_t kernelstartcond;
+  pthread_cond_t kerneldonecond;
+  int kerneljob;
+  int kernelyear;
+  int kernelbusy;
+  long kernelchunkland;
+  long kernelchunkcount;
+  long kernelnextchunk;
+} yearcontext;
+
+yearcontext *yearcontexts;
+
+pthread_t *yearworkerthreads;
+pthread_mutex_t yearworkermutex = PTHREAD_MUTEX_INITIALIZER;
+int nextworkeryear;
+
+/* Output grid sets - a ring of yearthreads + 1 sets indexed by year, the workers fill them and the writer thread writes them in year order */
+/* the sets hold the float results in land order - the writer normalizes and widens them to double one output slice at a time */
+
+typedef struct {
+  int year;
+  int full;
+  float *PCTNATVEGGrid;
+  float *PCTCROPGrid;
+  float *PCTPFTGrid[MAXPFT];
+  float *PCTCFTGrid[MAXCFT];
+  float *FERTNITROGrid[MAXCFT];
+  float *UNREPPFTGrid[MAXPFT];
+  float *UNREPCFTGrid[MAXCFT];
+  float *BIOHVH1Grid;
+  float *BIOHVH2Grid;
+  float *BIOHSH1Grid;
+  float *BIOHSH2Grid;
+  float *BIOHSH3Grid;
+} outputgridset;
+
+/* Writer slice buffers - per land pixel sums of the year being written and the double (or float) slices being written - */
+/* the double buffer holds outslicedepth slices so each 3d write covers whole chunks of outputchunktype types */
+
+double *outAllFracdblGrid;
+double *outAllPFTsdblGrid;
+double *outAllCFTsdblGrid;
+double *outslicedblGrid;
+float *outsliceGrid;
+long outslicedepth = 1;
+
+#define DBLFIELD_LANDFRAC 0
+#define DBLFIELD_AREA 1
+#define DBLFIELD_PCTGLACIER 2
+#define DBLFIELD_PCTLAKE 3
+#define DBLFIELD_PCTWETLAND 4
+#define DBLFIELD_PCTURBAN 5
+#define DBLFIELD_PCTNATVEG 6
+#define DBLFIELD_PCTCROP 7
+#define DBLFIELD_PCTPFT 8
+#define DBLFIELD_PCTCFT 9
+#define DBLFIELD_FERTNITRO 10
+#define DBLFIELD_UNREPPFT 11
+#define DBLFIELD_UNREPCFT 12
+#define DBLFIELD_BIOHVH1 13
+#define DBLFIELD_BIOHVH2 14
+#define DBLFIELD_BIOHSH1 15
+#define DBLFIELD_BIOHSH2 16
+#define DBLFIELD_BIOHSH3 17
+
+outputgridset *outputgridsets;
+int outputgridsetcount;
+
+/* Input grid sets - a ring of yearthreads + 1 sets indexed by year, the reader thread loads them ahead of the year workers */
+
+typedef struct {
+  int year;
+  int full;
+  float *CURRPRIMFGrid;
+  float *CURRPRIMNGrid;
+  float *CURRSECDFGrid;
+  float *CURRSECDNGrid;
+  float *CURRPASTRGrid;
+  float *CURRRANGEGrid;
+  float *CURRC3ANNGrid;
+  float *CURRC4ANNGrid;
+  float *CURRC3PERGrid;
+  float *CURRC4PERGrid;
+  float *CURRC3NFXGrid;
+  float *CURRURBANGrid;
+  float *PREVSECDFGrid;
+  float *PREVSECDNGrid;
+  float *PREVPASTRGrid;
+  float *PREVRANGEGrid;
+  float *PREVC3ANNGrid;
+  float *PREVC4ANNGrid;
+  float *PREVC3PERGrid;
+  float *PREVC4PERGrid;
+  float *PREVC3NFXGrid;
+  float *HARVESTVH1Grid;
+  float *HARVESTVH2Grid;
+  float *HARVESTSH1Grid;
+  float *HARVESTSH2Grid;
+  float *HARVESTSH3Grid;
+  float *BIOHVH1Grid;
+  float *BIOHVH2Grid;
+  float *BIOHSH1Grid;
+  float *BIOHSH2Grid;
+  float *BIOHSH3Grid;
+  float *FERTC3ANNGrid;
+  float *FERTC4ANNGrid;
+  float *FERTC3PERGrid;
+  float *FERTC4PERGrid;
+  float *FERTC3NFXGrid;
+  float *IRRIGC3ANNGrid;
+  float *IRRIGC4ANNGrid;
+  float *IRRIGC3PERGrid;
+  float *IRRIGC4PERGrid;
+  float *IRRIGC3NFXGrid;
+  float *UNREPSECDFGrid;
+  float *UNREPSECDNGrid;
+  float *UNREPPASTRGrid;
+  float *UNREPRANGEGrid;
+  float *UNREPC3ANNGrid;
+  float *UNREPC4ANNGrid;
+  float *UNREPC3PERGrid;
+  float *UNREPC4PERGrid;
+  float *UNREPC3NFXGrid;
+} inputgridset;
+
+inputgridset *inputgridsets;
+int inputgridsetcount;
+
+/* Unrepresented transitions - for each LUH source state the transitions out of it in the order they are summed into */
+/* its unrepresented loss, and where its previous, current and UNREP grids sit in an input set */
+
+#define UNREPSOURCES 9
+#define UNREPDESTINATIONS 9
+
+typedef struct {
+  char *source;
+  char *destinations[UNREPDESTINATIONS];
+  size_t prevgrid;
+  size_t currgrid;
+  size_t unrepgrid;
+} unreptransition;
+
+#define UNREPGRIDS(STATE) offsetof(inputgridset, PREV##STATE##Grid), offsetof(inputgridset, CURR##STATE##Grid), offsetof(inputgridset, UNREP##STATE##Grid)
+
+unreptransition unreptransitions[UNREPSOURCES] = {
+  {"secdf", {"secdn", "urban", "c3ann", "c4ann", "c3per", "c4per", "c3nfx", "pastr", "range"}, UNREPGRIDS(SECDF)},
+  {"secdn", {"secdf", "urban", "c3ann", "c4ann", "c3per", "c4per", "c3nfx", "pastr", "range"}, UNREPGRIDS(SECDN)},
+  {"pastr", {"secdn", "urban", "c3ann", "c4ann", "c3per", "c4per", "c3nfx", "secdf", "range"}, UNREPGRIDS(PASTR)},
+  {"range", {"secdn", "urban", "c3ann", "c4ann", "c3per", "c4per", "c3nfx", "pastr", "secdf"}, UNREPGRIDS(RANGE)},
+  {"c3ann", {"secdn", "urban", "secdf", "c4ann", "c3per", "c4per", "c3nfx", "pastr", "range"}, UNREPGRIDS(C3ANN)},
+  {"c4ann", {"secdn", "urban", "c3ann", "secdf", "c3per", "c4per", "c3nfx", "pastr", "range"}, UNREPGRIDS(C4ANN)},
+  {"c3per", {"secdn", "urban", "c3ann", "c4ann", "secdf", "c4per", "c3nfx", "pastr", "range"}, UNREPGRIDS(C3PER)},
+  {"c4per", {"secdn", "urban", "c3ann", "c4ann", "c3per", "secdf", "c3nfx", "pastr", "range"}, UNREPGRIDS(C4PER)},
+  {"c3nfx", {"secdn", "urban", "c3ann", "c4ann", "c3per", "c4per", "secdf", "pastr", "range"}, UNREPGRIDS(C3NFX)}
+};
+
+/* Input grid registry - the stage that fills each per year input grid and the stages that read it. A grid is only */
+/* carved and filled when its producer and one of its consumers are enabled, a grid that is read but whose producer */
+/* is off points at the shared zero grid, and a grid no enabled stage reads is left NULL */
+
+#define STAGE_CURRSTATES 0x001
+#define STAGE_PREVSTATES 0x002
+#define STAGE_WOODHARVEST 0x004
+#define STAGE_UNREP 0x008
+#define STAGE_MANAGEMENT 0x010
+#define STAGE_COLLECTION 0x020
+#define STAGE_PFT 0x040
+#define STAGE_CFT 0x080
+#define STAGE_HARVEST 0x100
+
+typedef struct {
+  char *name;
+  size_t grid;
+  int producer;
+  int consumers;
+} inputgridentry;
+
+#define INPUTGRID(FIELD) offsetof(inputgridset, FIELD##Grid)
+#define INPUTGRIDS ((int) (sizeof(inputgridregistry) / sizeof(inputgridentry)))
+
+/* name is the LUH variable a reader stage fills the grid from, or the source state of an UNREP grid - the pasture */
+/* and rangeland losses and the urban states are read by no stage */
+
+inputgridentry inputgridregistry[] = {
+  {"primf", INPUTGRID(CURRPRIMF), STAGE_CURRSTATES, STAGE_COLLECTION},
+  {"primn", INPUTGRID(CURRPRIMN), STAGE_CURRSTATES, STAGE_COLLECTION},
+  {"secdf", INPUTGRID(CURRSECDF), STAGE_CURRSTATES, STAGE_COLLECTION | STAGE_PREVSTATES | STAGE_UNREP},
+  {"secdn", INPUTGRID(CURRSECDN), STAGE_CURRSTATES, STAGE_COLLECTION | STAGE_PREVSTATES | STAGE_UNREP},
+  {"pastr", INPUTGRID(CURRPASTR), STAGE_CURRSTATES, STAGE_COLLECTION | STAGE_PFT},
+  {"range", INPUTGRID(CURRRANGE), STAGE_CURRSTATES, STAGE_COLLECTION},
+  {"c3ann", INPUTGRID(CURRC3ANN), STAGE_CURRSTATES, STAGE_COLLECTION | STAGE_CFT | STAGE_PREVSTATES | STAGE_UNREP},
+  {"c4ann", INPUTGRID(CURRC4ANN), STAGE_CURRSTATES, STAGE_COLLECTION | STAGE_CFT | STAGE_PREVSTATES | STAGE_UNREP},
+  {"c3per", INPUTGRID(CURRC3PER), STAGE_CURRSTATES, STAGE_COLLECTION | STAGE_CFT | STAGE_PREVSTATES | STAGE_UNREP},
+  {"c4per", INPUTGRID(CURRC4PER), STAGE_CURRSTATES, STAGE_COLLECTION | STAGE_CFT | STAGE_PREVSTATES | STAGE_UNREP},
+  {"c3nfx", INPUTGRID(CURRC3NFX), STAGE_CURRSTATES, STAGE_COLLECTION | STAGE_CFT | STAGE_PREVSTATES | STAGE_UNREP},
+  {"urban", INPUTGRID(CURRURBAN), STAGE_CURRSTATES, 0},
+  {"secdf", INPUTGRID(PREVSECDF), STAGE_PREVSTATES, STAGE_UNREP},
+  {"secdn", INPUTGRID(PREVSECDN), STAGE_PREVSTATES, STAGE_UNREP},
+  {"pastr", INPUTGRID(PREVPASTR), STAGE_PREVSTATES, 0},
+  {"range", INPUTGRID(PREVRANGE), STAGE_PREVSTATES, 0},
+  {"c3ann", INPUTGRID(PREVC3ANN), STAGE_PREVSTATES, STAGE_UNREP},
+  {"c4ann", INPUTGRID(PREVC4ANN), STAGE_PREVSTATES, STAGE_UNREP},
+  {"c3per", INPUTGRID(PREVC3PER), STAGE_PREVSTATES, STAGE_UNREP},
+  {"c4per", INPUTGRID(PREVC4PER), STAGE_PREVSTATES, STAGE_UNREP},
+  {"c3nfx", INPUTGRID(PREVC3NFX), STAGE_PREVSTATES, STAGE_UNREP},
+  {"primf_harv", INPUTGRID(HARVESTVH1), STAGE_WOODHARVEST, STAGE_HARVEST},
+  {"primn_harv", INPUTGRID(HARVESTVH2), STAGE_WOODHARVEST, STAGE_HARVEST},
+  {"secmf_harv", INPUTGRID(HARVESTSH1), STAGE_WOODHARVEST, STAGE_COLLECTION | STAGE_HARVEST},
+  {"secyf_harv", INPUTGRID(HARVESTSH2), STAGE_WOODHARVEST, STAGE_COLLECTION | STAGE_HARVEST},
+  {"secnf_harv", INPUTGRID(HARVESTSH3), STAGE_WOODHARVEST, STAGE_COLLECTION | STAGE_HARVEST},
+  {"primf_bioh", INPUTGRID(BIOHVH1), STAGE_WOODHARVEST, STAGE_HARVEST},
+  {"primn_bioh", INPUTGRID(BIOHVH2), STAGE_WOODHARVEST, STAGE_HARVEST},
+  {"secmf_bioh", INPUTGRID(BIOHSH1), STAGE_WOODHARVEST, STAGE_HARVEST},
+  {"secyf_bioh", INPUTGRID(BIOHSH2), STAGE_WOODHARVEST, STAGE_HARVEST},
+  {"secnf_bioh", INPUTGRID(BIOHSH3), STAGE_WOODHARVEST, STAGE_HARVEST},
+  {"fertl_c3ann", INPUTGRID(FERTC3ANN), STAGE_MANAGEMENT, STAGE_CFT},
+  {"fertl_c4ann", INPUTGRID(FERTC4ANN), STAGE_MANAGEMENT, STAGE_CFT},
+  {"fertl_c3per", INPUTGRID(FERTC3PER), STAGE_MANAGEMENT, STAGE_CFT},
+  {"fertl_c4per", INPUTGRID(FERTC4PER), STAGE_MANAGEMENT, STAGE_CFT},
+  {"fertl_c3nfx", INPUTGRID(FERTC3NFX), STAGE_MANAGEMENT, STAGE_CFT},
+  {"irrig_c3ann", INPUTGRID(IRRIGC3ANN), STAGE_MANAGEMENT, STAGE_CFT},
+  {"irrig_c4ann", INPUTGRID(IRRIGC4ANN), STAGE_MANAGEMENT, STAGE_CFT},
+  {"irrig_c3per", INPUTGRID(IRRIGC3PER), STAGE_MANAGEMENT, STAGE_CFT},
+  {"irrig_c4per", INPUTGRID(IRRIGC4PER), STAGE_MANAGEMENT, STAGE_CFT},
+  {"irrig_c3nfx", INPUTGRID(IRRIGC3NFX), STAGE_MANAGEMENT, STAGE_CFT},
+  {"secdf", INPUTGRID(UNREPSECDF), STAGE_UNREP, STAGE_COLLECTION},
+  {"secdn", INPUTGRID(UNREPSECDN), STAGE_UNREP, STAGE_COLLECTION},
+  {"pastr", INPUTGRID(UNREPPASTR), STAGE_UNREP, 0},
+  {"range", INPUTGRID(UNREPRANGE), STAGE_UNREP, 0},
+  {"c3ann", INPUTGRID(UNREPC3ANN), STAGE_UNREP, STAGE_CFT},
+  {"c4ann", INPUTGRID(UNREPC4ANN), STAGE_UNREP, STAGE_CFT},
+  {"c3per", INPUTGRID(UNREPC3PER), STAGE_UNREP, STAGE_CFT},
+  {"c4per", INPUTGRID(UNREPC4PER), STAGE_UNREP, STAGE_CFT},
+  {"c3nfx", INPUTGRID(UNREPC3NFX), STAGE_UNREP, STAGE_CFT}
+};
+
+pthread_t inputreaderthread;
+pthread_mutex_t inputreadermutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t inputreadercond = PTHREAD_COND_INITIALIZER;
+
+/* Output writer thread - netCDF is not thread safe so all library calls hold ncaccessmutex */
+
+pthread_t outputwriterthread;
+pthread_mutex_t ncaccessmutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t outputwritermutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t outputwritercond = PTHREAD_COND_INITIALIZER;
+int outputwriterrunning = 0;
+int outputwritererrorstat = 0;
+int outputwritererrorline = 0;
+int outputwrittenyear;
+
+/* Phase timing - wall and CPU seconds, netCDF bytes and pixels of each phase of each year, summed over the tiles */
+/* and written as CSV next to the outputs at the end of the run - row 0 holds the once per tile reference and base */
+/* state reads, the bytes are counted per thread by the readnc and writenc functions */
+
+#define PHASE_REFERENCE 0
+#define PHASE_BASESTATES 1
+#define PHASE_STATES 2
+#define PHASE_WOODHARVEST 3
+#define PHASE_TRANSITIONS 4
+#define PHASE_MANAGEMENT 5
+#define PHASE_GENERATE 6
+#define PHASE_WRITE 7
+#define PHASES 8
+#define PHASEYEAR_TILE -1
+
+char *phasenames[PHASES] = {"reference", "basestates", "states", "woodharvest", "transitions", "management", "generate", "write"};
+
+typedef struct {
+  double wallseconds;
+  double cpuseconds;
+  long bytesread;
+  long byteswritten;
+  long pixels;
+} phasetiming;
+
+typedef struct {
+  double wallstart;
+  double cpustart;
+  long bytesreadstart;
+  long byteswrittenstart;
+} phaseclock;
+
+phasetiming *phasetimings;
+pthread_mutex_t phasetimingmutex = PTHREAD_MUTEX_INITIALIZER;
+__thread long threadbytesread = 0;
+__thread long threadbyteswritten = 0;
+
+/* Flip row - each reading thread's own row of scratch for flipgridrows, allocated on its first flipped read */
+
+__thread float *fliprow = NULL;
+__thread long fliprowpix = 0;
 
 /* Out Surface Data NetCDF variables */
-int  stat;  /* return status */
 int  ncid;  /* netCDF id */
+int  outncid;  /* netCDF id of the output file being written */
+long outputrecord = -1;  /* time record of the year being written - negative for one file per year */
+int  outputseriesfirstyear;  /* year of time record 0 in the time series output file */
+
+/* Input NetCDF file pool - each input file is opened once per run and its ncid reused */
+#define MAXNCINPUTPOOL 32
+char ncinputpoolfilename[MAXNCINPUTPOOL][1024];
+int ncinputpoolid[MAXNCINPUTPOOL];
+int ncinputpoolsize = 0;
+
+/* Grid arenas - every grid lives in one anonymous mapping advised onto transparent huge pages, laid out by lifetime */
+/* class: the reference grids (recarved for each tile), the tile grids, the per year input sets and the per year */
+/* output sets - each class starts on its own huge page and its grids on cache line boundaries */
+
+#define GRIDARENAALIGN (2 * 1024 * 1024)
+#define GRIDALIGN 64
+#define GRIDARENAS 4
+#define GRIDARENA_REFERENCE 0
+#define GRIDARENA_TILE 1
+#define GRIDARENA_INPUT 2
+#define GRIDARENA_OUTPUT 3
+
+typedef struct {
+  char *base;
+  size_t size;
+  size_t offset;
+} gridarena;
+
+gridarena gridarenas[GRIDARENAS];
+
+/* Reference cache - the CLM reference databases for the region as one flat native endian file that later runs mmap */
+/* read only and share through the page cache - every field starts on its own page */
+
+#define REFCACHEMAGIC "CLMREF01"
+#define REFCACHEALIGN 4096
+#define REFCACHESOURCES 9
+
+typedef struct {
+  char magic[8];
+  long maxoutpix;
+  long maxoutlin;
+  long southlatoffset;
+  long lonoffset;
+  long maxpft;
+  long maxcft;
+  long maxcftraw;
+  long pixelmajor;
+  char sourcefile[REFCACHESOURCES][1024];
+  long sourcesize[REFCACHESOURCES];
+  long sourcemtime[REFCACHESOURCES];
+  long datasize;
+  float EDGEN;
+  float EDGEE;
+  float EDGES;
+  float EDGEW;
+} referencecacheheader;
+
+char *referencecachebase = NULL;
+size_t referencecachesize;
+FILE *referencecachefile = NULL;
+size_t referencecacheoffset;
 
 /* dimension ids */
 int natpft_dim;
@@ -288,6 +689,7 @@ int cft_dim;
 int lon_dim;
 int lat_dim;
 int nchar_dim;
+int time_dim;
 
 /* dimension lengths */
 size_t natpft_len = 15;
@@ -299,6 +701,7 @@ size_t nchar_len = 128;
 /* variable ids */
 int natpft_id;
 int cft_id;
+int YEAR_id;
 int EDGEN_id;
 int EDGEE_id;
 int EDGES_id;
@@ -331,6 +734,7 @@ int UNREPRESENTED_CFT_LULCC_id;
 /* variable shapes */
 int natpft_dims[RANK_natpft];
 int cft_dims[RANK_cft];
+int YEAR_dims[RANK_YEAR];
 int LAT_dims[RANK_LAT];
 int LATIXY_dims[RANK_LATIXY];
 int LON_dims[RANK_LON];
@@ -391,6 +795,54 @@ int readnamelist(char *namelist) {
   fscanf(namelistfile,"%s %d",fieldname,&flipLUHgrids);
   fscanf(namelistfile,"%s %d",fieldname,&includeOcean);
 
+  /* optional output storage settings - namelists without these lines keep the defaults */
+  fscanf(namelistfile,"%s %d",fieldname,&outputdeflate);
+  fscanf(namelistfile,"%s %d",fieldname,&outputshuffle);
+  fscanf(namelistfile,"%s %ld",fieldname,&outputchunktype);
+  fscanf(namelistfile,"%s %ld",fieldname,&outputchunklat);
+  fscanf(namelistfile,"%s %ld",fieldname,&outputchunklon);
+  fscanf(namelistfile,"%s %d",fieldname,&yearthreads);
+  fscanf(namelistfile,"%s %s",fieldname,referencecache);
+  fscanf(namelistfile,"%s %d",fieldname,&outputtimeseries);
+  fscanf(namelistfile,"%s %ld",fieldname,&maxmemory);
+  fscanf(namelistfile,"%s %d",fieldname,&pixelmajorgrids);
+  fscanf(namelistfile,"%s %d",fieldname,&kernelthreads);
+  fscanf(namelistfile,"%s %d",fieldname,&unrepresentedlulcc);
+
+  if (outputdeflate < 0) {
+      outputdeflate = 0;
+  }
+  if (outputdeflate > 9) {
+      outputdeflate = 9;
+  }
+
+  outslicedepth = outputchunktype;
+  if (outslicedepth < 1) {
+      outslicedepth = 1;
+  }
+  if (outslicedepth > MAXCFT) {
+      outslicedepth = MAXCFT;
+  }
+
+  if (yearthreads < 1) {
+      yearthreads = 1;
+  }
+
+  if (kernelthreads < 1) {
+      kernelthreads = 1;
+  }
+
+  if (pixelmajorgrids == 1) {
+      PFTPIXSTEP = MAXPFT;
+      CFTPIXSTEP = MAXCFT;
+      CFTRAWPIXSTEP = MAXCFTRAW;
+  }
+
+  enabledstages = STAGE_CURRSTATES | STAGE_WOODHARVEST | STAGE_MANAGEMENT | STAGE_COLLECTION | STAGE_PFT | STAGE_CFT | STAGE_HARVEST;
+  if (unrepresentedlulcc == 1) {
+      enabledstages = enabledstages | STAGE_PREVSTATES | STAGE_UNREP;
+  }
+
   return 0;
 
 }
@@ -410,8 +862,8 @@ int setregionoptions() {
   fscanf(pftparamfile,"%f",&pixsize);
   
   OUTPIXSIZE = pixsize;
-  MAXOUTPIX = (long) (urlon - lllon) / OUTPIXSIZE;
-  MAXOUTLIN = (long) (urlat - lllat) / OUTPIXSIZE;
+  MAXOUTPIX = (long) ((urlon - lllon) / OUTPIXSIZE + 0.5);
+  MAXOUTLIN = (long) ((urlat - lllat) / OUTPIXSIZE + 0.5);
 
   lon_len = MAXOUTPIX;
   lat_len = MAXOUTLIN;
@@ -419,8 +871,12 @@ int setregionoptions() {
   OUTLLX = lllon;
   OUTLLY = lllat;
   
-  OUTLATOFFSET = (long) (90.0 - urlat) / OUTPIXSIZE;
-  OUTLONOFFSET = (long) (lllon + 180.0) / OUTPIXSIZE;
+  /* Region offsets into the global input grids - OUTLATOFFSET counts rows from the north for flipped (north up) LUH grids */
+  /* and OUTSOUTHLATOFFSET counts rows from the south for unflipped (south up) CLM grids */
+  
+  OUTLATOFFSET = (long) ((90.0 - urlat) / OUTPIXSIZE + 0.5);
+  OUTSOUTHLATOFFSET = (long) ((lllat + 90.0) / OUTPIXSIZE + 0.5);
+  OUTLONOFFSET = (long) ((lllon + 180.0) / OUTPIXSIZE + 0.5);
 
   OUTDATASIZE = MAXOUTPIX * MAXOUTLIN * sizeof(float);
   OUTDBLDATASIZE = MAXOUTPIX * MAXOUTLIN * sizeof(double);
@@ -429,211 +885,586 @@ int setregionoptions() {
 
 }
 
-int createallgrids() {
+int inputgridlive(inputgridentry *entry) {
 
-  int pftid, cftid;
+  return (enabledstages & entry->producer) != 0 && (enabledstages & entry->consumers) != 0;
 
-  tempGrid = (float *) malloc(OUTDATASIZE);
-  tempoutGrid = (float *) malloc(OUTDATASIZE);
-  tempflipGrid = (float *) malloc(OUTDATASIZE);
-  translossGrid = (float *) malloc(OUTDATASIZE);
-
-  innatpft = (int *) malloc(MAXPFT * sizeof(int));
-  incft = (int *) malloc(MAXCFT * sizeof(int));
-  inLAT = (float *) malloc(MAXOUTLIN * sizeof(float));
-  inLATIXY = (float *) malloc(OUTDATASIZE);
-  inLON = (float *) malloc(MAXOUTPIX * sizeof(float));
-  inLONGXY = (float *) malloc(OUTDATASIZE);
-
-  inLANDMASKGrid = (float *) malloc(OUTDATASIZE);
-  inLANDFRACGrid = (float *) malloc(OUTDATASIZE);
-  inAREAGrid = (float *) malloc(OUTDATASIZE);
-  inPCTGLACIERGrid = (float *) malloc(OUTDATASIZE);
-  inPCTLAKEGrid = (float *) malloc(OUTDATASIZE);
-  inPCTWETLANDGrid = (float *) malloc(OUTDATASIZE);
-  inPCTURBANGrid = (float *) malloc(OUTDATASIZE);
-  inPCTNATVEGGrid = (float *) malloc(OUTDATASIZE);
-  inPCTCROPGrid = (float *) malloc(OUTDATASIZE);
-  
-  for (pftid = 0; pftid < MAXPFT; pftid++) {
-      inCURRENTPCTPFTGrid[pftid] = (float *) malloc(OUTDATASIZE);
+}
+
+int liveinputgrids() {
+
+  int entryid, livecount;
+
+  livecount = 0;
+  for (entryid = 0; entryid < INPUTGRIDS; entryid++) {
+      livecount += inputgridlive(&inputgridregistry[entryid]);
   }
 
-  for (cftid = 0; cftid < MAXCFT; cftid++) {  
-      inCURRENTPCTCFTGrid[cftid] = (float *) malloc(OUTDATASIZE);
+  return livecount;
+
+}
+
+float **inputsetgrid(inputgridset *gridset, size_t grid) {
+
+  /* the grid pointer at one registry or transitions table offset of an input set */
+
+  return (float **) ((char *) gridset + grid);
+
+}
+
+long tilerowsize() {
+
+  /* bytes one row of a band costs across all the grids createtilegrids carves from the arenas, including the */
+  /* land index - keep the counts in step with that function */
+
+  long rowgrids;
+
+  rowgrids = 11 + 4 * MAXPFT + MAXCFT + 5 * MAXCFTRAW;
+  rowgrids = rowgrids + 1 + 12;
+  if ((enabledstages & STAGE_UNREP) != 0) {
+      rowgrids = rowgrids + 1;
   }
-  
-  for (pftid = 0; pftid < MAXPFT; pftid++) {
-      inFORESTPCTPFTGrid[pftid] = (float *) malloc(OUTDATASIZE);
-      inPASTUREPCTPFTGrid[pftid] = (float *) malloc(OUTDATASIZE);
-      inOTHERPCTPFTGrid[pftid] = (float *) malloc(OUTDATASIZE);
-  }
-  
-  for (cftid = 0; cftid < MAXCFTRAW; cftid++) {
-      inC3ANNPCTCFTGrid[cftid] = (float *) malloc(OUTDATASIZE);
-      inC4ANNPCTCFTGrid[cftid] = (float *) malloc(OUTDATASIZE);
-      inC3PERPCTCFTGrid[cftid] = (float *) malloc(OUTDATASIZE);
-      inC4PERPCTCFTGrid[cftid] = (float *) malloc(OUTDATASIZE);
-      inC3NFXPCTCFTGrid[cftid] = (float *) malloc(OUTDATASIZE);
-  }
-
-  inBASEPRIMFGrid = (float *) malloc(OUTDATASIZE);
-  inBASEPRIMNGrid = (float *) malloc(OUTDATASIZE);
-  inBASESECDFGrid = (float *) malloc(OUTDATASIZE);
-  inBASESECDNGrid = (float *) malloc(OUTDATASIZE);
-  inBASEPASTRGrid = (float *) malloc(OUTDATASIZE);
-  inBASERANGEGrid = (float *) malloc(OUTDATASIZE);
-  inBASEC3ANNGrid = (float *) malloc(OUTDATASIZE);
-  inBASEC4ANNGrid = (float *) malloc(OUTDATASIZE);
-  inBASEC3PERGrid = (float *) malloc(OUTDATASIZE);
-  inBASEC4PERGrid = (float *) malloc(OUTDATASIZE);
-  inBASEC3NFXGrid = (float *) malloc(OUTDATASIZE);
-  inBASEURBANGrid = (float *) malloc(OUTDATASIZE);
-
-  inCURRPRIMFGrid = (float *) malloc(OUTDATASIZE);
-  inCURRPRIMNGrid = (float *) malloc(OUTDATASIZE);
-  inCURRSECDFGrid = (float *) malloc(OUTDATASIZE);
-  inCURRSECDNGrid = (float *) malloc(OUTDATASIZE);
-  inCURRPASTRGrid = (float *) malloc(OUTDATASIZE);
-  inCURRRANGEGrid = (float *) malloc(OUTDATASIZE);
-  inCURRC3ANNGrid = (float *) malloc(OUTDATASIZE);
-  inCURRC4ANNGrid = (float *) malloc(OUTDATASIZE);
-  inCURRC3PERGrid = (float *) malloc(OUTDATASIZE);
-  inCURRC4PERGrid = (float *) malloc(OUTDATASIZE);
-  inCURRC3NFXGrid = (float *) malloc(OUTDATASIZE);
-  inCURRURBANGrid = (float *) malloc(OUTDATASIZE);
-
-  inPREVSECDFGrid = (float *) malloc(OUTDATASIZE);
-  inPREVSECDNGrid = (float *) malloc(OUTDATASIZE);
-  inPREVPASTRGrid = (float *) malloc(OUTDATASIZE);
-  inPREVRANGEGrid = (float *) malloc(OUTDATASIZE);
-  inPREVC3ANNGrid = (float *) malloc(OUTDATASIZE);
-  inPREVC4ANNGrid = (float *) malloc(OUTDATASIZE);
-  inPREVC3PERGrid = (float *) malloc(OUTDATASIZE);
-  inPREVC4PERGrid = (float *) malloc(OUTDATASIZE);
-  inPREVC3NFXGrid = (float *) malloc(OUTDATASIZE);
-
-  inHARVESTVH1Grid = (float *) malloc(OUTDATASIZE);
-  inHARVESTVH2Grid = (float *) malloc(OUTDATASIZE);
-  inHARVESTSH1Grid = (float *) malloc(OUTDATASIZE);
-  inHARVESTSH2Grid = (float *) malloc(OUTDATASIZE);
-  inHARVESTSH3Grid = (float *) malloc(OUTDATASIZE);
-
-  inBIOHVH1Grid = (float *) malloc(OUTDATASIZE);
-  inBIOHVH2Grid = (float *) malloc(OUTDATASIZE);
-  inBIOHSH1Grid = (float *) malloc(OUTDATASIZE);
-  inBIOHSH2Grid = (float *) malloc(OUTDATASIZE);
-  inBIOHSH3Grid = (float *) malloc(OUTDATASIZE);
-
-  inUNREPSECDFGrid = (float *) malloc(OUTDATASIZE);
-  inUNREPSECDNGrid = (float *) malloc(OUTDATASIZE);
-  inUNREPPASTRGrid = (float *) malloc(OUTDATASIZE);
-  inUNREPRANGEGrid = (float *) malloc(OUTDATASIZE);
-  inUNREPC3ANNGrid = (float *) malloc(OUTDATASIZE);
-  inUNREPC4ANNGrid = (float *) malloc(OUTDATASIZE);
-  inUNREPC3PERGrid = (float *) malloc(OUTDATASIZE);
-  inUNREPC4PERGrid = (float *) malloc(OUTDATASIZE);
-  inUNREPC3NFXGrid = (float *) malloc(OUTDATASIZE);
-
-  inFERTC3ANNGrid = (float *) malloc(OUTDATASIZE);
-  inFERTC4ANNGrid = (float *) malloc(OUTDATASIZE);
-  inFERTC3PERGrid = (float *) malloc(OUTDATASIZE);
-  inFERTC4PERGrid = (float *) malloc(OUTDATASIZE);
-  inFERTC3NFXGrid = (float *) malloc(OUTDATASIZE);
-
-  inIRRIGC3ANNGrid = (float *) malloc(OUTDATASIZE);
-  inIRRIGC4ANNGrid = (float *) malloc(OUTDATASIZE);
-  inIRRIGC3PERGrid = (float *) malloc(OUTDATASIZE);
-  inIRRIGC4PERGrid = (float *) malloc(OUTDATASIZE);
-  inIRRIGC3NFXGrid = (float *) malloc(OUTDATASIZE);
-
-  inBASEFORESTTOTALGrid = (float *) malloc(OUTDATASIZE);
-  inBASENONFORESTTOTALGrid = (float *) malloc(OUTDATASIZE);
-  inBASECROPTOTALGrid = (float *) malloc(OUTDATASIZE);
-  inBASEMISSINGGrid = (float *) malloc(OUTDATASIZE);
-  inBASEOTHERGrid = (float *) malloc(OUTDATASIZE);
-  inBASENATVEGGrid = (float *) malloc(OUTDATASIZE);
-
-  inCURRFORESTTOTALGrid = (float *) malloc(OUTDATASIZE);
-  inCURRNONFORESTTOTALGrid = (float *) malloc(OUTDATASIZE);
-  inCURRCROPTOTALGrid = (float *) malloc(OUTDATASIZE);
-  inCURRMISSINGGrid = (float *) malloc(OUTDATASIZE);
-  inCURROTHERGrid = (float *) malloc(OUTDATASIZE);
-  inCURRNATVEGGrid = (float *) malloc(OUTDATASIZE);
-
-  inUNREPFORESTGrid = (float *) malloc(OUTDATASIZE);
-  inUNREPOTHERGrid = (float *) malloc(OUTDATASIZE);
-
-  outPCTNATVEGGrid = (float *) malloc(OUTDATASIZE);
-  outPCTCROPGrid = (float *) malloc(OUTDATASIZE);
-  
-  for (pftid = 0; pftid < MAXPFT; pftid++) {
-      outPCTPFTGrid[pftid] = (float *) malloc(OUTDATASIZE);
+  rowgrids = rowgrids + (yearthreads + 1) * liveinputgrids();
+  rowgrids = rowgrids + (yearthreads + 1) * (2 + 2 * MAXPFT + 3 * MAXCFT + 5);
+  rowgrids = rowgrids + 1 + (3 + outslicedepth) * sizeof(double) / sizeof(float);
+  rowgrids = rowgrids + sizeof(long) / sizeof(float);
+
+  return rowgrids * MAXOUTPIX * sizeof(float);
+
+}
+
+int setbandoptions() {
+
+  /* the region is generated in tiles of whole rows - each tile is split between the MPI ranks into bands of BANDLIN */
+  /* rows and a tile becomes the rank's region through settileoptions - maxmemory (MB per rank, 0 for no limit) sets */
+  /* BANDLIN, which is a whole multiple of the output chunk rows so no two tiles or ranks ever write into one chunk */
+
+  long chunklin, memorylin;
+
+#ifdef USEMPI
+  MPI_Comm_rank(MPI_COMM_WORLD, &mpirank);
+  MPI_Comm_size(MPI_COMM_WORLD, &mpisize);
+#endif
+
+  REGIONLATOFFSET = OUTLATOFFSET;
+  REGIONSOUTHLATOFFSET = OUTSOUTHLATOFFSET;
+  sprintf(referencecacheroot,"%s",referencecache);
+
+  chunklin = 1;
+  if (outputchunklat > 0 && outputchunklat < (long) lat_len) {
+      chunklin = outputchunklat;
   }
-  
-  for (cftid = 0; cftid < MAXCFT; cftid++) {
-      outPCTCFTGrid[cftid] = (float *) malloc(OUTDATASIZE);
+
+  BANDLIN = (lat_len + mpisize - 1) / mpisize;
+  BANDLIN = (BANDLIN + chunklin - 1) / chunklin * chunklin;
+
+  if (maxmemory > 0) {
+      memorylin = maxmemory * 1024 * 1024 / tilerowsize() / chunklin * chunklin;
+      if (memorylin < chunklin) {
+          printf("maxmemory %ld MB is less than one tile of %ld rows\n",maxmemory,chunklin);
+          memorylin = chunklin;
+      }
+      if (memorylin < BANDLIN) {
+          BANDLIN = memorylin;
+      }
   }
-  
-  for (pftid = 0; pftid < MAXPFT; pftid++) {
-      outUNREPPFTGrid[pftid] = (float *) malloc(OUTDATASIZE);
+
+  if (BANDLIN < (long) lat_len && outputchunklat <= 0) {
+      outputchunklat = BANDLIN;
   }
 
-  for (cftid = 0; cftid < MAXCFT; cftid++) {
-      outUNREPCFTGrid[cftid] = (float *) malloc(OUTDATASIZE);
+  if (BANDLIN * (mpisize - 1) >= (long) lat_len) {
+      printf("Region of %ld rows is too small for %d ranks of %ld rows\n",(long) lat_len,mpisize,BANDLIN);
+      exit(1);
   }
+
+  TILELIN = BANDLIN * mpisize;
+  tilecount = (lat_len + TILELIN - 1) / TILELIN;
+
+  return 0;
+
+}
+
+int settileoptions(int tileid) {
+
+  /* point the region rows, offsets and sizes at this rank's band of one tile - the band of the last tile may be short */
+  /* or even empty, every rank still takes part in each tile so the collective output calls line up */
+
+  long bandstart;
+
+  currenttile = tileid;
+  bandstart = tileid * TILELIN + mpirank * BANDLIN;
   
-  for (cftid = 0; cftid < MAXCFT; cftid++) {
-      outFERTNITROGrid[cftid] = (float *) malloc(OUTDATASIZE);
+  MAXOUTLIN = BANDLIN;
+  if (bandstart + BANDLIN > (long) lat_len) {
+      MAXOUTLIN = lat_len - bandstart;
+  }
+  if (MAXOUTLIN < 0) {
+      MAXOUTLIN = 0;
+      bandstart = lat_len;
   }
-  
-  outHARVESTVH1Grid = (float *) malloc(OUTDATASIZE);
-  outHARVESTVH2Grid = (float *) malloc(OUTDATASIZE);
-  outHARVESTSH1Grid = (float *) malloc(OUTDATASIZE);
-  outHARVESTSH2Grid = (float *) malloc(OUTDATASIZE);
-  outHARVESTSH3Grid = (float *) malloc(OUTDATASIZE);
 
-  outBIOHVH1Grid = (float *) malloc(OUTDATASIZE);
-  outBIOHVH2Grid = (float *) malloc(OUTDATASIZE);
-  outBIOHSH1Grid = (float *) malloc(OUTDATASIZE);
-  outBIOHSH2Grid = (float *) malloc(OUTDATASIZE);
-  outBIOHSH3Grid = (float *) malloc(OUTDATASIZE);
+  OUTBANDLATOFFSET = bandstart;
+  OUTSOUTHLATOFFSET = REGIONSOUTHLATOFFSET + bandstart;
+  OUTLATOFFSET = REGIONLATOFFSET + lat_len - bandstart - MAXOUTLIN;
 
-  outLANDFRACdblGrid = (double *) malloc(OUTDBLDATASIZE);
-  outAREAdblGrid = (double *) malloc(OUTDBLDATASIZE);
-  outPCTGLACIERdblGrid = (double *) malloc(OUTDBLDATASIZE);
-  outPCTLAKEdblGrid = (double *) malloc(OUTDBLDATASIZE);
-  outPCTWETLANDdblGrid = (double *) malloc(OUTDBLDATASIZE);
-  outPCTURBANdblGrid = (double *) malloc(OUTDBLDATASIZE);
+  OUTDATASIZE = MAXOUTPIX * MAXOUTLIN * sizeof(float);
+  OUTDBLDATASIZE = MAXOUTPIX * MAXOUTLIN * sizeof(double);
 
-  outPCTNATVEGdblGrid = (double *) malloc(OUTDBLDATASIZE);
-  outPCTCROPdblGrid = (double *) malloc(OUTDBLDATASIZE);
-  
-  for (pftid = 0; pftid < MAXPFT; pftid++) {
-      outPCTPFTdblGrid[pftid] = (double *) malloc(OUTDBLDATASIZE);
+  if (tilecount > 1 || mpisize > 1) {
+      printf("Rank %d of %d tile %d of %d: latitude rows %ld to %ld\n",mpirank,mpisize,tileid,tilecount,bandstart,bandstart + MAXOUTLIN - 1);
   }
+
+  /* each band of each tile caches its own rows */
   
-  for (cftid = 0; cftid < MAXCFT; cftid++) {
-      outPCTCFTdblGrid[cftid] = (double *) malloc(OUTDBLDATASIZE);
+  if (strcmp(referencecacheroot, "none") != 0) {
+      if (tilecount > 1 || mpisize > 1) {
+          sprintf(referencecache,"%s.tile%dband%dof%d",referencecacheroot,tileid,mpirank,mpisize);
+      }
   }
-  
+
+  return 0;
+
+}
+
+int setblockgrids(float **blockgrids, float *blockGrid, int blockcount) {
+
+  /* a pixel of any slice is always blockgrids[type][pixel * pixstep] - the slices start one grid apart in a plane */
+  /* major block and one value apart in a pixel major block */
+
+  int blockid;
+
+  for (blockid = 0; blockid < blockcount; blockid++) {
+      if (pixelmajorgrids == 1) {
+          blockgrids[blockid] = blockGrid + blockid;
+      }
+      else {
+          blockgrids[blockid] = blockGrid + blockid * MAXOUTPIX * MAXOUTLIN;
+      }
+  }
+
+  return 0;
+
+}
+
+long blocktypestep(float **blockgrids) {
+
+  /* distance between two types of one pixel - blocks sized for different tiles differ in plane major layout */
+
+  return blockgrids[1] - blockgrids[0];
+
+}
+
+int resetgridarena(int arenaid) {
+
+  gridarenas[arenaid].offset = 0;
+
+  return 0;
+
+}
+
+void *creategrid(int arenaid, size_t gridsize) {
+
+  /* carve the next grid out of an arena - before the arenas are mapped this only counts the bytes each class needs */
+
+  gridarena *arena;
+  char *grid;
+
+  arena = &gridarenas[arenaid];
+  arena->offset = (arena->offset + GRIDALIGN - 1) / GRIDALIGN * GRIDALIGN;
+  grid = NULL;
+  if (arena->base != NULL) {
+      if (arena->offset + gridsize > arena->size) {
+          printf("Grid arena %d of %ld bytes is too small for this tile\n",arenaid,(long) arena->size);
+          exit(1);
+      }
+      grid = arena->base + arena->offset;
+  }
+  arena->offset += gridsize;
+
+  return grid;
+
+}
+
+int mapgridarenas() {
+
+  /* one mapping for every arena sized by a counting pass - anonymous pages are zero and only become resident when */
+  /* first touched, and the huge page advice is only a hint so kernels without it still run */
+
+  size_t arenasize[GRIDARENAS], mapsize;
+  char *mapbase;
+  int arenaid;
+
+  mapsize = 0;
+  for (arenaid = 0; arenaid < GRIDARENAS; arenaid++) {
+      arenasize[arenaid] = (gridarenas[arenaid].offset + GRIDARENAALIGN - 1) / GRIDARENAALIGN * GRIDARENAALIGN;
+      mapsize += arenasize[arenaid];
+  }
+
+  printf("Allocating %ld MB of grids\n",(long) (mapsize / (1024 * 1024)));
+  mapbase = (char *) mmap(NULL, mapsize + GRIDARENAALIGN, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapbase == MAP_FAILED) {
+      printf("Unable to allocate %ld MB of grids\n",(long) (mapsize / (1024 * 1024)));
+      exit(1);
+  }
+  mapbase = (char *) (((size_t) mapbase + GRIDARENAALIGN - 1) / GRIDARENAALIGN * GRIDARENAALIGN);
+#ifdef MADV_HUGEPAGE
+  madvise(mapbase, mapsize, MADV_HUGEPAGE);
+#endif
+
+  for (arenaid = 0; arenaid < GRIDARENAS; arenaid++) {
+      gridarenas[arenaid].base = mapbase;
+      gridarenas[arenaid].size = arenasize[arenaid];
+      gridarenas[arenaid].offset = 0;
+      mapbase += arenasize[arenaid];
+  }
+
+  return 0;
+
+}
+
+int createblockgrids(int arenaid, float **blockgrids, int blockcount) {
+
+  /* one contiguous block for a whole 3D variable - the per slice grids are views into the block */
+
+  setblockgrids(blockgrids,(float *) creategrid(arenaid,OUTDATASIZE * blockcount),blockcount);
+
+  return 0;
+
+}
+
+int clearblockrange(float **blockgrids, int blockcount, long pixstep, long landstart, long landend) {
+
+  /* zero a range of land pixels in every slice of a block - one run when the block is pixel major */
+
+  int blockid;
+
+  if (pixstep > 1) {
+      memset(blockgrids[0] + landstart * pixstep, 0, (landend - landstart) * pixstep * sizeof(float));
+  }
+  else {
+      for (blockid = 0; blockid < blockcount; blockid++) {
+          memset(blockgrids[blockid] + landstart, 0, (landend - landstart) * sizeof(float));
+      }
+  }
+
+  return 0;
+
+}
+
+int createinputgridset(inputgridset *gridset) {
+
+  inputgridentry *entry;
+  int entryid;
+
+  gridset->year = 0;
+  gridset->full = 0;
+
+  for (entryid = 0; entryid < INPUTGRIDS; entryid++) {
+      entry = &inputgridregistry[entryid];
+      if (inputgridlive(entry)) {
+          *inputsetgrid(gridset, entry->grid) = (float *) creategrid(GRIDARENA_INPUT,OUTDATASIZE);
+      }
+      else if ((enabledstages & entry->consumers) != 0) {
+          *inputsetgrid(gridset, entry->grid) = zeroGrid;
+      }
+      else {
+          *inputsetgrid(gridset, entry->grid) = NULL;
+      }
+  }
+
+  return 0;
+
+}
+
+int selectinputgridset(inputgridset *gridset) {
+
+  /* point the calling thread's per year in*Grid globals at a grid set */
+
+  inCURRPRIMFGrid = gridset->CURRPRIMFGrid;
+  inCURRPRIMNGrid = gridset->CURRPRIMNGrid;
+  inCURRSECDFGrid = gridset->CURRSECDFGrid;
+  inCURRSECDNGrid = gridset->CURRSECDNGrid;
+  inCURRPASTRGrid = gridset->CURRPASTRGrid;
+  inCURRRANGEGrid = gridset->CURRRANGEGrid;
+  inCURRC3ANNGrid = gridset->CURRC3ANNGrid;
+  inCURRC4ANNGrid = gridset->CURRC4ANNGrid;
+  inCURRC3PERGrid = gridset->CURRC3PERGrid;
+  inCURRC4PERGrid = gridset->CURRC4PERGrid;
+  inCURRC3NFXGrid = gridset->CURRC3NFXGrid;
+  inCURRURBANGrid = gridset->CURRURBANGrid;
+  inPREVSECDFGrid = gridset->PREVSECDFGrid;
+  inPREVSECDNGrid = gridset->PREVSECDNGrid;
+  inPREVPASTRGrid = gridset->PREVPASTRGrid;
+  inPREVRANGEGrid = gridset->PREVRANGEGrid;
+  inPREVC3ANNGrid = gridset->PREVC3ANNGrid;
+  inPREVC4ANNGrid = gridset->PREVC4ANNGrid;
+  inPREVC3PERGrid = gridset->PREVC3PERGrid;
+  inPREVC4PERGrid = gridset->PREVC4PERGrid;
+  inPREVC3NFXGrid = gridset->PREVC3NFXGrid;
+  inHARVESTVH1Grid = gridset->HARVESTVH1Grid;
+  inHARVESTVH2Grid = gridset->HARVESTVH2Grid;
+  inHARVESTSH1Grid = gridset->HARVESTSH1Grid;
+  inHARVESTSH2Grid = gridset->HARVESTSH2Grid;
+  inHARVESTSH3Grid = gridset->HARVESTSH3Grid;
+  inBIOHVH1Grid = gridset->BIOHVH1Grid;
+  inBIOHVH2Grid = gridset->BIOHVH2Grid;
+  inBIOHSH1Grid = gridset->BIOHSH1Grid;
+  inBIOHSH2Grid = gridset->BIOHSH2Grid;
+  inBIOHSH3Grid = gridset->BIOHSH3Grid;
+  inFERTC3ANNGrid = gridset->FERTC3ANNGrid;
+  inFERTC4ANNGrid = gridset->FERTC4ANNGrid;
+  inFERTC3PERGrid = gridset->FERTC3PERGrid;
+  inFERTC4PERGrid = gridset->FERTC4PERGrid;
+  inFERTC3NFXGrid = gridset->FERTC3NFXGrid;
+  inIRRIGC3ANNGrid = gridset->IRRIGC3ANNGrid;
+  inIRRIGC4ANNGrid = gridset->IRRIGC4ANNGrid;
+  inIRRIGC3PERGrid = gridset->IRRIGC3PERGrid;
+  inIRRIGC4PERGrid = gridset->IRRIGC4PERGrid;
+  inIRRIGC3NFXGrid = gridset->IRRIGC3NFXGrid;
+  inUNREPSECDFGrid = gridset->UNREPSECDFGrid;
+  inUNREPSECDNGrid = gridset->UNREPSECDNGrid;
+  inUNREPPASTRGrid = gridset->UNREPPASTRGrid;
+  inUNREPRANGEGrid = gridset->UNREPRANGEGrid;
+  inUNREPC3ANNGrid = gridset->UNREPC3ANNGrid;
+  inUNREPC4ANNGrid = gridset->UNREPC4ANNGrid;
+  inUNREPC3PERGrid = gridset->UNREPC3PERGrid;
+  inUNREPC4PERGrid = gridset->UNREPC4PERGrid;
+  inUNREPC3NFXGrid = gridset->UNREPC3NFXGrid;
+
+  return 0;
+
+}
+
+int createoutputgridset(outputgridset *gridset) {
+
+  gridset->year = 0;
+  gridset->full = 0;
+  gridset->PCTNATVEGGrid = (float *) creategrid(GRIDARENA_OUTPUT,OUTDATASIZE);
+  gridset->PCTCROPGrid = (float *) creategrid(GRIDARENA_OUTPUT,OUTDATASIZE);
+  createblockgrids(GRIDARENA_OUTPUT,gridset->PCTPFTGrid,MAXPFT);
+  createblockgrids(GRIDARENA_OUTPUT,gridset->PCTCFTGrid,MAXCFT);
+  createblockgrids(GRIDARENA_OUTPUT,gridset->FERTNITROGrid,MAXCFT);
+  createblockgrids(GRIDARENA_OUTPUT,gridset->UNREPPFTGrid,MAXPFT);
+  createblockgrids(GRIDARENA_OUTPUT,gridset->UNREPCFTGrid,MAXCFT);
+  gridset->BIOHVH1Grid = (float *) creategrid(GRIDARENA_OUTPUT,OUTDATASIZE);
+  gridset->BIOHVH2Grid = (float *) creategrid(GRIDARENA_OUTPUT,OUTDATASIZE);
+  gridset->BIOHSH1Grid = (float *) creategrid(GRIDARENA_OUTPUT,OUTDATASIZE);
+  gridset->BIOHSH2Grid = (float *) creategrid(GRIDARENA_OUTPUT,OUTDATASIZE);
+  gridset->BIOHSH3Grid = (float *) creategrid(GRIDARENA_OUTPUT,OUTDATASIZE);
+
+  return 0;
+
+}
+
+int selectoutputgridset(outputgridset *gridset) {
+
+  /* point the calling thread's per year float out*Grid globals at a grid set */
+
+  int pftid, cftid;
+
+  outPCTNATVEGGrid = gridset->PCTNATVEGGrid;
+  outPCTCROPGrid = gridset->PCTCROPGrid;
+
   for (pftid = 0; pftid < MAXPFT; pftid++) {
-      outUNREPPFTdblGrid[pftid] = (double *) malloc(OUTDBLDATASIZE);
+      outPCTPFTGrid[pftid] = gridset->PCTPFTGrid[pftid];
+      outUNREPPFTGrid[pftid] = gridset->UNREPPFTGrid[pftid];
   }
 
   for (cftid = 0; cftid < MAXCFT; cftid++) {
-      outUNREPCFTdblGrid[cftid] = (double *) malloc(OUTDBLDATASIZE);
+      outPCTCFTGrid[cftid] = gridset->PCTCFTGrid[cftid];
+      outFERTNITROGrid[cftid] = gridset->FERTNITROGrid[cftid];
+      outUNREPCFTGrid[cftid] = gridset->UNREPCFTGrid[cftid];
   }
+
+  outBIOHVH1Grid = gridset->BIOHVH1Grid;
+  outBIOHVH2Grid = gridset->BIOHVH2Grid;
+  outBIOHSH1Grid = gridset->BIOHSH1Grid;
+  outBIOHSH2Grid = gridset->BIOHSH2Grid;
+  outBIOHSH3Grid = gridset->BIOHSH3Grid;
+
+  return 0;
+
+}
+
+int createyearcontext(yearcontext *context) {
+
+  pthread_mutex_init(&context->kernelmutex, NULL);
+  pthread_cond_init(&context->kernelstartcond, NULL);
+  pthread_cond_init(&context->kerneldonecond, NULL);
+  context->kerneljob = 0;
+
+  return 0;
+
+}
+
+int createkernelscratch() {
+
+  /* the calling thread's intermediate grids for one block of land pixels - small enough that a block's values pass */
+  /* from kernel to kernel through the cache */
+
+  inBASEFORESTTOTALGrid = (float *) malloc(KERNELBLOCKLAND * sizeof(float));
+  inBASENONFORESTTOTALGrid = (float *) malloc(KERNELBLOCKLAND * sizeof(float));
+  inBASECROPTOTALGrid = (float *) malloc(KERNELBLOCKLAND * sizeof(float));
+  inBASEMISSINGGrid = (float *) malloc(KERNELBLOCKLAND * sizeof(float));
+  inBASEOTHERGrid = (float *) malloc(KERNELBLOCKLAND * sizeof(float));
+  inBASENATVEGGrid = (float *) malloc(KERNELBLOCKLAND * sizeof(float));
+  inCURRFORESTTOTALGrid = (float *) malloc(KERNELBLOCKLAND * sizeof(float));
+  inCURRNONFORESTTOTALGrid = (float *) malloc(KERNELBLOCKLAND * sizeof(float));
+  inCURRCROPTOTALGrid = (float *) malloc(KERNELBLOCKLAND * sizeof(float));
+  inCURRMISSINGGrid = (float *) malloc(KERNELBLOCKLAND * sizeof(float));
+  inCURROTHERGrid = (float *) malloc(KERNELBLOCKLAND * sizeof(float));
+  inCURRNATVEGGrid = (float *) malloc(KERNELBLOCKLAND * sizeof(float));
+  inUNREPFORESTGrid = (float *) malloc(KERNELBLOCKLAND * sizeof(float));
+  inUNREPOTHERGrid = (float *) malloc(KERNELBLOCKLAND * sizeof(float));
+  outHARVESTVH1Grid = (float *) malloc(KERNELBLOCKLAND * sizeof(float));
+  outHARVESTVH2Grid = (float *) malloc(KERNELBLOCKLAND * sizeof(float));
+  outHARVESTSH1Grid = (float *) malloc(KERNELBLOCKLAND * sizeof(float));
+  outHARVESTSH2Grid = (float *) malloc(KERNELBLOCKLAND * sizeof(float));
+  outHARVESTSH3Grid = (float *) malloc(KERNELBLOCKLAND * sizeof(float));
+
+  return 0;
+
+}
+
+int freekernelscratch() {
+
+  free(inBASEFORESTTOTALGrid);
+  free(inBASENONFORESTTOTALGrid);
+  free(inBASECROPTOTALGrid);
+  free(inBASEMISSINGGrid);
+  free(inBASEOTHERGrid);
+  free(inBASENATVEGGrid);
+  free(inCURRFORESTTOTALGrid);
+  free(inCURRNONFORESTTOTALGrid);
+  free(inCURRCROPTOTALGrid);
+  free(inCURRMISSINGGrid);
+  free(inCURROTHERGrid);
+  free(inCURRNATVEGGrid);
+  free(inUNREPFORESTGrid);
+  free(inUNREPOTHERGrid);
+  free(outHARVESTVH1Grid);
+  free(outHARVESTVH2Grid);
+  free(outHARVESTSH1Grid);
+  free(outHARVESTSH2Grid);
+  free(outHARVESTSH3Grid);
+
+  return 0;
+
+}
+
+int createreferencegrids() {
+
+  /* the CLM reference grids - only carved when they are read from netCDF rather than mapped from the reference cache, */
+  /* each tile carves them again from the start of the reference arena */
+
+  resetgridarena(GRIDARENA_REFERENCE);
+
+  innatpft = (int *) creategrid(GRIDARENA_REFERENCE,MAXPFT * sizeof(int));
+  incft = (int *) creategrid(GRIDARENA_REFERENCE,MAXCFT * sizeof(int));
+  inLAT = (float *) creategrid(GRIDARENA_REFERENCE,MAXOUTLIN * sizeof(float));
+  inLATIXY = (float *) creategrid(GRIDARENA_REFERENCE,OUTDATASIZE);
+  inLON = (float *) creategrid(GRIDARENA_REFERENCE,MAXOUTPIX * sizeof(float));
+  inLONGXY = (float *) creategrid(GRIDARENA_REFERENCE,OUTDATASIZE);
+
+  inLANDMASKGrid = (float *) creategrid(GRIDARENA_REFERENCE,OUTDATASIZE);
+  inLANDFRACGrid = (float *) creategrid(GRIDARENA_REFERENCE,OUTDATASIZE);
+  inAREAGrid = (float *) creategrid(GRIDARENA_REFERENCE,OUTDATASIZE);
+  inPCTGLACIERGrid = (float *) creategrid(GRIDARENA_REFERENCE,OUTDATASIZE);
+  inPCTLAKEGrid = (float *) creategrid(GRIDARENA_REFERENCE,OUTDATASIZE);
+  inPCTWETLANDGrid = (float *) creategrid(GRIDARENA_REFERENCE,OUTDATASIZE);
+  inPCTURBANGrid = (float *) creategrid(GRIDARENA_REFERENCE,OUTDATASIZE);
+  inPCTNATVEGGrid = (float *) creategrid(GRIDARENA_REFERENCE,OUTDATASIZE);
+  inPCTCROPGrid = (float *) creategrid(GRIDARENA_REFERENCE,OUTDATASIZE);
   
-  for (cftid = 0; cftid < MAXCFT; cftid++) {
-      outFERTNITROdblGrid[cftid] = (double *) malloc(OUTDBLDATASIZE);
-  }
+  createblockgrids(GRIDARENA_REFERENCE,inCURRENTPCTPFTGrid,MAXPFT);
+  createblockgrids(GRIDARENA_REFERENCE,inCURRENTPCTCFTGrid,MAXCFT);
+
+  createblockgrids(GRIDARENA_REFERENCE,inFORESTPCTPFTGrid,MAXPFT);
+  createblockgrids(GRIDARENA_REFERENCE,inPASTUREPCTPFTGrid,MAXPFT);
+  createblockgrids(GRIDARENA_REFERENCE,inOTHERPCTPFTGrid,MAXPFT);
   
-  outBIOHVH1dblGrid = (double *) malloc(OUTDBLDATASIZE);
-  outBIOHVH2dblGrid = (double *) malloc(OUTDBLDATASIZE);
-  outBIOHSH1dblGrid = (double *) malloc(OUTDBLDATASIZE);
-  outBIOHSH2dblGrid = (double *) malloc(OUTDBLDATASIZE);
-  outBIOHSH3dblGrid = (double *) malloc(OUTDBLDATASIZE);
+  createblockgrids(GRIDARENA_REFERENCE,inC3ANNPCTCFTGrid,MAXCFTRAW);
+  createblockgrids(GRIDARENA_REFERENCE,inC4ANNPCTCFTGrid,MAXCFTRAW);
+  createblockgrids(GRIDARENA_REFERENCE,inC3PERPCTCFTGrid,MAXCFTRAW);
+  createblockgrids(GRIDARENA_REFERENCE,inC4PERPCTCFTGrid,MAXCFTRAW);
+  createblockgrids(GRIDARENA_REFERENCE,inC3NFXPCTCFTGrid,MAXCFTRAW);
+
+  return 0;
+
+}
+
+int createtilegrids() {
+
+  /* every grid but the kernel scratch, carved into its lifetime class - run once to size the arenas and again to carve */
+
+  int setid;
+
+  createreferencegrids();
+
+  resetgridarena(GRIDARENA_TILE);
+
+  zeroGrid = (float *) creategrid(GRIDARENA_TILE,OUTDATASIZE);
+  tempGrid = NULL;
+  if ((enabledstages & STAGE_UNREP) != 0) {
+      tempGrid = (float *) creategrid(GRIDARENA_TILE,OUTDATASIZE);
+  }
+
+  inBASEPRIMFGrid = (float *) creategrid(GRIDARENA_TILE,OUTDATASIZE);
+  inBASEPRIMNGrid = (float *) creategrid(GRIDARENA_TILE,OUTDATASIZE);
+  inBASESECDFGrid = (float *) creategrid(GRIDARENA_TILE,OUTDATASIZE);
+  inBASESECDNGrid = (float *) creategrid(GRIDARENA_TILE,OUTDATASIZE);
+  inBASEPASTRGrid = (float *) creategrid(GRIDARENA_TILE,OUTDATASIZE);
+  inBASERANGEGrid = (float *) creategrid(GRIDARENA_TILE,OUTDATASIZE);
+  inBASEC3ANNGrid = (float *) creategrid(GRIDARENA_TILE,OUTDATASIZE);
+  inBASEC4ANNGrid = (float *) creategrid(GRIDARENA_TILE,OUTDATASIZE);
+  inBASEC3PERGrid = (float *) creategrid(GRIDARENA_TILE,OUTDATASIZE);
+  inBASEC4PERGrid = (float *) creategrid(GRIDARENA_TILE,OUTDATASIZE);
+  inBASEC3NFXGrid = (float *) creategrid(GRIDARENA_TILE,OUTDATASIZE);
+  inBASEURBANGrid = (float *) creategrid(GRIDARENA_TILE,OUTDATASIZE);
+
+  outAllFracdblGrid = (double *) creategrid(GRIDARENA_TILE,OUTDBLDATASIZE);
+  outAllPFTsdblGrid = (double *) creategrid(GRIDARENA_TILE,OUTDBLDATASIZE);
+  outAllCFTsdblGrid = (double *) creategrid(GRIDARENA_TILE,OUTDBLDATASIZE);
+  outslicedblGrid = (double *) creategrid(GRIDARENA_TILE,OUTDBLDATASIZE * outslicedepth);
+  outsliceGrid = (float *) creategrid(GRIDARENA_TILE,OUTDATASIZE);
+
+  landpixindex = (long *) creategrid(GRIDARENA_TILE,MAXOUTPIX * MAXOUTLIN * sizeof(long));
+
+  resetgridarena(GRIDARENA_INPUT);
+  for (setid = 0; setid < inputgridsetcount; setid++) {
+      createinputgridset(&inputgridsets[setid]);
+  }
+
+  resetgridarena(GRIDARENA_OUTPUT);
+  for (setid = 0; setid < outputgridsetcount; setid++) {
+      createoutputgridset(&outputgridsets[setid]);
+  }
+
+  return 0;
+
+}
+
+int createallgrids() {
+
+  int setid;
+
+  inputgridsetcount = yearthreads + 1;
+  inputgridsets = (inputgridset *) malloc(inputgridsetcount * sizeof(inputgridset));
+
+  outputgridsetcount = yearthreads + 1;
+  outputgridsets = (outputgridset *) malloc(outputgridsetcount * sizeof(outputgridset));
+
+  printf("Reading %d of %d per year input grids\n",liveinputgrids(),INPUTGRIDS);
+
+  createtilegrids();
+  mapgridarenas();
+  createtilegrids();
+
+  yearcontexts = (yearcontext *) malloc(yearthreads * sizeof(yearcontext));
+  for (setid = 0; setid < yearthreads; setid++) {
+      createyearcontext(&yearcontexts[setid]);
+  }
 
   return 0;
 
@@ -698,40 +1529,30 @@ readcftparamfile() {
 }
 
 
-int initializeGrids() {
+int initializeGrids(long landstart, long landend) {
 
-  long clmlin, clmpix;
-  long pftid, cftid;
-  float clmlat, clmlatdistance, clmlondistance, clmarea;
-  
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          outPCTNATVEGGrid[MAXOUTPIX * MAXOUTLIN] = 0.0;
-          outPCTCROPGrid[MAXOUTPIX * MAXOUTLIN] = 0.0;
-          for (pftid = 0; pftid < MAXPFT; pftid++) {
-              outPCTPFTGrid[pftid][clmlin * MAXOUTPIX + clmpix] = 0.0;
-              outUNREPPFTGrid[pftid][clmlin * MAXOUTPIX + clmpix] = 0.0;
-          }
+  /* clear the outputs the kernels accumulate into or only write for some pixels - PCTNATVEG, PCTCROP and the PCTPFT */
+  /* and UNREPPFT blocks are written for every land pixel so they are left as they are */
 
-          outHARVESTVH1Grid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-          outHARVESTVH2Grid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-          outHARVESTSH1Grid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-          outHARVESTSH2Grid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-          outHARVESTSH3Grid[clmlin * MAXOUTPIX + clmpix] = 0.0;
+  long landcount;
 
-          outBIOHVH1Grid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-          outBIOHVH2Grid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-          outBIOHSH1Grid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-          outBIOHSH2Grid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-          outBIOHSH3Grid[clmlin * MAXOUTPIX + clmpix] = 0.0;
+  landcount = landend - landstart;
 
-          for (cftid = 0; cftid < MAXCFT; cftid++) {
-              outPCTCFTGrid[cftid][clmlin * MAXOUTPIX + clmpix] = 0.0;
-              outFERTNITROGrid[cftid][clmlin * MAXOUTPIX + clmpix] = 0.0;
-              outUNREPCFTGrid[cftid][clmlin * MAXOUTPIX + clmpix] = 0.0;
-          }
-      }
-  }
+  clearblockrange(outPCTCFTGrid,MAXCFT,CFTPIXSTEP,landstart,landend);
+  clearblockrange(outFERTNITROGrid,MAXCFT,CFTPIXSTEP,landstart,landend);
+  clearblockrange(outUNREPCFTGrid,MAXCFT,CFTPIXSTEP,landstart,landend);
+
+  memset(outHARVESTVH1Grid, 0, landcount * sizeof(float));
+  memset(outHARVESTVH2Grid, 0, landcount * sizeof(float));
+  memset(outHARVESTSH1Grid, 0, landcount * sizeof(float));
+  memset(outHARVESTSH2Grid, 0, landcount * sizeof(float));
+  memset(outHARVESTSH3Grid, 0, landcount * sizeof(float));
+
+  memset(outBIOHVH1Grid + landstart, 0, landcount * sizeof(float));
+  memset(outBIOHVH2Grid + landstart, 0, landcount * sizeof(float));
+  memset(outBIOHSH1Grid + landstart, 0, landcount * sizeof(float));
+  memset(outBIOHSH2Grid + landstart, 0, landcount * sizeof(float));
+  memset(outBIOHSH3Grid + landstart, 0, landcount * sizeof(float));
 
   return 0;
                 
@@ -741,6 +1562,16 @@ void
 check_err(const int stat, const int line, const char *file) {
 
     if (stat != NC_NOERR) {
+        if (outputwriterrunning == 1 && pthread_equal(pthread_self(), outputwriterthread)) {
+            /* hand the error back to the main thread rather than exiting from the writer */
+            pthread_mutex_unlock(&ncaccessmutex);
+            pthread_mutex_lock(&outputwritermutex);
+            outputwritererrorstat = stat;
+            outputwritererrorline = line;
+            pthread_cond_broadcast(&outputwritercond);
+            pthread_mutex_unlock(&outputwritermutex);
+            pthread_exit(NULL);
+        }
         (void)fprintf(stderr,"line %d of %s: %s\n", line, file, nc_strerror(stat));
         fflush(stderr);
         exit(1);
@@ -750,10 +1581,26 @@ check_err(const int stat, const int line, const char *file) {
 int
 openncinputfile(char *netcdffilename) {
 
+    int poolindex;
+    int stat;
+
+    for (poolindex = 0; poolindex < ncinputpoolsize; poolindex++) {
+        if (strcmp(ncinputpoolfilename[poolindex],netcdffilename) == 0) {
+            ncid = ncinputpoolid[poolindex];
+            return 0;
+        }
+    }
+
     printf("Opening NetCDF File: %s\n",netcdffilename); 
     stat = nc_open(netcdffilename, NC_NOWRITE, &ncid);
     check_err(stat,__LINE__,__FILE__);
 
+    if (ncinputpoolsize < MAXNCINPUTPOOL) {
+        sprintf(ncinputpoolfilename[ncinputpoolsize],"%s",netcdffilename);
+        ncinputpoolid[ncinputpoolsize] = ncid;
+        ncinputpoolsize++;
+    }
+
     return 0;
 
 }
@@ -761,8 +1608,14 @@ openncinputfile(char *netcdffilename) {
 int
 openncoutputfile(char *netcdffilename) {
 
+    int stat;
+
     printf("Opening NetCDF File: %s\n",netcdffilename); 
-    stat = nc_open(netcdffilename, NC_WRITE, &ncid);
+#ifdef USEMPI
+    stat = nc_open_par(netcdffilename, NC_WRITE, MPI_COMM_WORLD, MPI_INFO_NULL, &outncid);
+#else
+    stat = nc_open(netcdffilename, NC_WRITE, &outncid);
+#endif
     check_err(stat,__LINE__,__FILE__);
 
     return 0;
@@ -770,185 +1623,278 @@ openncoutputfile(char *netcdffilename) {
 }
 
 int
-createncoutputfile(char *netcdffilename) {
+defncvarstorage(int varid, int varrank, int recordvar, size_t typelen) {
 
-    printf("Creating NetCDF File: %s\n",netcdffilename); 
+    /* chunk gridded output by whole lat lon slices (or the namelist chunk shape) and one type per chunk so */
+    /* CLM can read a single PFT or CFT without decompressing the whole cube - mostly zero CFT layers deflate well */
+    /* time series variables get one year per chunk so each appended record only touches its own chunks - */
+    /* typelen is the length of the natpft or cft dimension of rank 3 variables */
 
-    /* enter define mode */
-    stat = nc_create(netcdffilename, NC_CLOBBER|NC_NETCDF4|NC_CLASSIC_MODEL, &ncid);
+    int stat;
+    size_t chunksizes[4];
+    int chunkdim;
+    long chunklat, chunklon, chunktype;
+    
+    chunklat = outputchunklat;
+    if (chunklat <= 0 || chunklat > (long) lat_len) {
+        chunklat = lat_len;
+    }
+    chunklon = outputchunklon;
+    if (chunklon <= 0 || chunklon > (long) lon_len) {
+        chunklon = lon_len;
+    }
+    chunktype = outputchunktype;
+    if (chunktype <= 0) {
+        chunktype = 1;
+    }
+    if (varrank == 3 && chunktype > (long) typelen) {
+        chunktype = typelen;
+    }
+
+    chunkdim = 0;
+    if (recordvar > 0) {
+        chunksizes[chunkdim++] = 1;
+    }
+    if (varrank == 3) {
+        chunksizes[chunkdim++] = chunktype;
+    }
+    chunksizes[chunkdim++] = chunklat;
+    chunksizes[chunkdim++] = chunklon;
+
+    stat = nc_def_var_chunking(outncid, varid, NC_CHUNKED, chunksizes);
+    check_err(stat,__LINE__,__FILE__);
+
+    if (outputdeflate > 0 || outputshuffle > 0) {
+        stat = nc_def_var_deflate(outncid, varid, outputshuffle > 0, outputdeflate > 0, outputdeflate);
+        check_err(stat,__LINE__,__FILE__);
+    }
+
+#ifdef USEMPI
+    /* compressed and record variables can only be written collectively - every rank writes its band of every slice */
+    stat = nc_var_par_access(outncid, varid, NC_COLLECTIVE);
+    check_err(stat,__LINE__,__FILE__);
+#endif
+
+    return 0;
+
+}
+
+int
+defncyearvar(char *varname, nc_type vartype, int varrank, int *vardims, int *varid) {
+
+    /* a variable written once per year - time series output puts the unlimited time dimension in front */
+
+    int stat, dimid;
+    int yeardims[4];
+    size_t typelen;
+
+    if (outputtimeseries > 0) {
+        yeardims[0] = time_dim;
+        for (dimid = 0; dimid < varrank; dimid++) {
+            yeardims[dimid + 1] = vardims[dimid];
+        }
+        stat = nc_def_var(outncid, varname, vartype, varrank + 1, yeardims, varid);
+    }
+    else {
+        stat = nc_def_var(outncid, varname, vartype, varrank, vardims, varid);
+    }
+    check_err(stat,__LINE__,__FILE__);
+
+    typelen = 1;
+    if (varrank == 3) {
+        stat = nc_inq_dimlen(outncid, vardims[0], &typelen);
+        check_err(stat,__LINE__,__FILE__);
+    }
+    defncvarstorage(*varid, varrank, outputtimeseries > 0, typelen);
+
+    return 0;
+
+}
+
+int
+createncoutputfile(char *netcdffilename) {
+
+    int stat;
+
+    printf("Creating NetCDF File: %s\n",netcdffilename); 
+
+    /* enter define mode */
+#ifdef USEMPI
+    stat = nc_create_par(netcdffilename, NC_CLOBBER|NC_NETCDF4|NC_CLASSIC_MODEL, MPI_COMM_WORLD, MPI_INFO_NULL, &outncid);
+#else
+    stat = nc_create(netcdffilename, NC_CLOBBER|NC_NETCDF4|NC_CLASSIC_MODEL, &outncid);
+#endif
     check_err(stat,__LINE__,__FILE__);
 
     /* define dimensions */
-    stat = nc_def_dim(ncid, "natpft", natpft_len, &natpft_dim);
+    stat = nc_def_dim(outncid, "natpft", natpft_len, &natpft_dim);
     check_err(stat,__LINE__,__FILE__);
-    stat = nc_def_dim(ncid, "cft", cft_len, &cft_dim);
+    stat = nc_def_dim(outncid, "cft", cft_len, &cft_dim);
     check_err(stat,__LINE__,__FILE__);
-    stat = nc_def_dim(ncid, "lon", lon_len, &lon_dim);
+    stat = nc_def_dim(outncid, "lon", lon_len, &lon_dim);
     check_err(stat,__LINE__,__FILE__);
-    stat = nc_def_dim(ncid, "lat", lat_len, &lat_dim);
+    stat = nc_def_dim(outncid, "lat", lat_len, &lat_dim);
     check_err(stat,__LINE__,__FILE__);
-    stat = nc_def_dim(ncid, "nchar", nchar_len, &nchar_dim);
+    stat = nc_def_dim(outncid, "nchar", nchar_len, &nchar_dim);
     check_err(stat,__LINE__,__FILE__);
+    if (outputtimeseries > 0) {
+        stat = nc_def_dim(outncid, "time", NC_UNLIMITED, &time_dim);
+        check_err(stat,__LINE__,__FILE__);
+    }
 
     /* define variables */
 
     natpft_dims[0] = natpft_dim;
-    stat = nc_def_var(ncid, "natpft", NC_INT, RANK_natpft, natpft_dims, &natpft_id);
+    stat = nc_def_var(outncid, "natpft", NC_INT, RANK_natpft, natpft_dims, &natpft_id);
     check_err(stat,__LINE__,__FILE__);
 
     cft_dims[0] = cft_dim;
-    stat = nc_def_var(ncid, "cft", NC_INT, RANK_cft, cft_dims, &cft_id);
+    stat = nc_def_var(outncid, "cft", NC_INT, RANK_cft, cft_dims, &cft_id);
     check_err(stat,__LINE__,__FILE__);
 
-    stat = nc_def_var(ncid, "EDGEN", NC_FLOAT, RANK_EDGEN, 0, &EDGEN_id);
+    if (outputtimeseries > 0) {
+        YEAR_dims[0] = time_dim;
+        stat = nc_def_var(outncid, "YEAR", NC_INT, RANK_YEAR, YEAR_dims, &YEAR_id);
+        check_err(stat,__LINE__,__FILE__);
+#ifdef USEMPI
+        stat = nc_var_par_access(outncid, YEAR_id, NC_COLLECTIVE);
+        check_err(stat,__LINE__,__FILE__);
+#endif
+    }
+
+    stat = nc_def_var(outncid, "EDGEN", NC_FLOAT, RANK_EDGEN, 0, &EDGEN_id);
     check_err(stat,__LINE__,__FILE__);
 
-    stat = nc_def_var(ncid, "EDGEE", NC_FLOAT, RANK_EDGEE, 0, &EDGEE_id);
+    stat = nc_def_var(outncid, "EDGEE", NC_FLOAT, RANK_EDGEE, 0, &EDGEE_id);
     check_err(stat,__LINE__,__FILE__);
 
-    stat = nc_def_var(ncid, "EDGES", NC_FLOAT, RANK_EDGES, 0, &EDGES_id);
+    stat = nc_def_var(outncid, "EDGES", NC_FLOAT, RANK_EDGES, 0, &EDGES_id);
     check_err(stat,__LINE__,__FILE__);
 
-    stat = nc_def_var(ncid, "EDGEW", NC_FLOAT, RANK_EDGEW, 0, &EDGEW_id);
+    stat = nc_def_var(outncid, "EDGEW", NC_FLOAT, RANK_EDGEW, 0, &EDGEW_id);
     check_err(stat,__LINE__,__FILE__);
 
     LAT_dims[0] = lat_dim;
-    stat = nc_def_var(ncid, "LAT", NC_FLOAT, RANK_LAT, LAT_dims, &LAT_id);
+    stat = nc_def_var(outncid, "LAT", NC_FLOAT, RANK_LAT, LAT_dims, &LAT_id);
     check_err(stat,__LINE__,__FILE__);
 
     LATIXY_dims[0] = lat_dim;
     LATIXY_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "LATIXY", NC_FLOAT, RANK_LATIXY, LATIXY_dims, &LATIXY_id);
+    stat = nc_def_var(outncid, "LATIXY", NC_FLOAT, RANK_LATIXY, LATIXY_dims, &LATIXY_id);
     check_err(stat,__LINE__,__FILE__);
+    defncvarstorage(LATIXY_id, RANK_LATIXY, 0, 1);
 
     LON_dims[0] = lon_dim;
-    stat = nc_def_var(ncid, "LON", NC_FLOAT, RANK_LON, LON_dims, &LON_id);
+    stat = nc_def_var(outncid, "LON", NC_FLOAT, RANK_LON, LON_dims, &LON_id);
     check_err(stat,__LINE__,__FILE__);
 
     LONGXY_dims[0] = lat_dim;
     LONGXY_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "LONGXY", NC_FLOAT, RANK_LONGXY, LONGXY_dims, &LONGXY_id);
+    stat = nc_def_var(outncid, "LONGXY", NC_FLOAT, RANK_LONGXY, LONGXY_dims, &LONGXY_id);
     check_err(stat,__LINE__,__FILE__);
+    defncvarstorage(LONGXY_id, RANK_LONGXY, 0, 1);
 
     LANDMASK_dims[0] = lat_dim;
     LANDMASK_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "LANDMASK", NC_FLOAT, RANK_LANDMASK, LANDMASK_dims, &LANDMASK_id);
+    stat = nc_def_var(outncid, "LANDMASK", NC_FLOAT, RANK_LANDMASK, LANDMASK_dims, &LANDMASK_id);
     check_err(stat,__LINE__,__FILE__);
+    defncvarstorage(LANDMASK_id, RANK_LANDMASK, 0, 1);
 
     LANDFRAC_dims[0] = lat_dim;
     LANDFRAC_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "LANDFRAC", NC_DOUBLE, RANK_LANDFRAC, LANDFRAC_dims, &LANDFRAC_id);
-    check_err(stat,__LINE__,__FILE__);
+    defncyearvar("LANDFRAC", NC_DOUBLE, RANK_LANDFRAC, LANDFRAC_dims, &LANDFRAC_id);
 
     AREA_dims[0] = lat_dim;
     AREA_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "AREA", NC_DOUBLE, RANK_AREA, AREA_dims, &AREA_id);
-    check_err(stat,__LINE__,__FILE__);
+    defncyearvar("AREA", NC_DOUBLE, RANK_AREA, AREA_dims, &AREA_id);
 
     PCT_GLACIER_dims[0] = lat_dim;
     PCT_GLACIER_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "PCT_GLACIER", NC_DOUBLE, RANK_PCT_GLACIER, PCT_GLACIER_dims, &PCT_GLACIER_id);
-    check_err(stat,__LINE__,__FILE__);
+    defncyearvar("PCT_GLACIER", NC_DOUBLE, RANK_PCT_GLACIER, PCT_GLACIER_dims, &PCT_GLACIER_id);
 
     PCT_LAKE_dims[0] = lat_dim;
     PCT_LAKE_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "PCT_LAKE", NC_DOUBLE, RANK_PCT_LAKE, PCT_LAKE_dims, &PCT_LAKE_id);
-    check_err(stat,__LINE__,__FILE__);
+    defncyearvar("PCT_LAKE", NC_DOUBLE, RANK_PCT_LAKE, PCT_LAKE_dims, &PCT_LAKE_id);
 
     PCT_WETLAND_dims[0] = lat_dim;
     PCT_WETLAND_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "PCT_WETLAND", NC_DOUBLE, RANK_PCT_WETLAND, PCT_WETLAND_dims, &PCT_WETLAND_id);
-    check_err(stat,__LINE__,__FILE__);
+    defncyearvar("PCT_WETLAND", NC_DOUBLE, RANK_PCT_WETLAND, PCT_WETLAND_dims, &PCT_WETLAND_id);
 
     PCT_URBAN_dims[0] = lat_dim;
     PCT_URBAN_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "PCT_URBAN", NC_DOUBLE, RANK_PCT_URBAN, PCT_URBAN_dims, &PCT_URBAN_id);
-    check_err(stat,__LINE__,__FILE__);
+    defncyearvar("PCT_URBAN", NC_DOUBLE, RANK_PCT_URBAN, PCT_URBAN_dims, &PCT_URBAN_id);
 
     PCT_NATVEG_dims[0] = lat_dim;
     PCT_NATVEG_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "PCT_NATVEG", NC_DOUBLE, RANK_PCT_NATVEG, PCT_NATVEG_dims, &PCT_NATVEG_id);
-    check_err(stat,__LINE__,__FILE__);
+    defncyearvar("PCT_NATVEG", NC_DOUBLE, RANK_PCT_NATVEG, PCT_NATVEG_dims, &PCT_NATVEG_id);
 
     PCT_CROP_dims[0] = lat_dim;
     PCT_CROP_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "PCT_CROP", NC_DOUBLE, RANK_PCT_CROP, PCT_CROP_dims, &PCT_CROP_id);
-    check_err(stat,__LINE__,__FILE__);
+    defncyearvar("PCT_CROP", NC_DOUBLE, RANK_PCT_CROP, PCT_CROP_dims, &PCT_CROP_id);
 
     PCT_NAT_PFT_dims[0] = natpft_dim;
     PCT_NAT_PFT_dims[1] = lat_dim;
     PCT_NAT_PFT_dims[2] = lon_dim;
-    stat = nc_def_var(ncid, "PCT_NAT_PFT", NC_DOUBLE, RANK_PCT_NAT_PFT, PCT_NAT_PFT_dims, &PCT_NAT_PFT_id);
-    check_err(stat,__LINE__,__FILE__);
+    defncyearvar("PCT_NAT_PFT", NC_DOUBLE, RANK_PCT_NAT_PFT, PCT_NAT_PFT_dims, &PCT_NAT_PFT_id);
 
     PCT_CFT_dims[0] = cft_dim;
     PCT_CFT_dims[1] = lat_dim;
     PCT_CFT_dims[2] = lon_dim;
-    stat = nc_def_var(ncid, "PCT_CFT", NC_DOUBLE, RANK_PCT_CFT, PCT_CFT_dims, &PCT_CFT_id);
-    check_err(stat,__LINE__,__FILE__);
+    defncyearvar("PCT_CFT", NC_DOUBLE, RANK_PCT_CFT, PCT_CFT_dims, &PCT_CFT_id);
 
     FERTNITRO_CFT_dims[0] = cft_dim;
     FERTNITRO_CFT_dims[1] = lat_dim;
     FERTNITRO_CFT_dims[2] = lon_dim;
-    stat = nc_def_var(ncid, "FERTNITRO_CFT", NC_DOUBLE, RANK_FERTNITRO_CFT, FERTNITRO_CFT_dims, &FERTNITRO_CFT_id);
-    check_err(stat,__LINE__,__FILE__);
+    defncyearvar("FERTNITRO_CFT", NC_DOUBLE, RANK_FERTNITRO_CFT, FERTNITRO_CFT_dims, &FERTNITRO_CFT_id);
 
     HARVEST_VH1_dims[0] = lat_dim;
     HARVEST_VH1_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "HARVEST_VH1", NC_DOUBLE, RANK_HARVEST_VH1, HARVEST_VH1_dims, &HARVEST_VH1_id);
-    check_err(stat,__LINE__,__FILE__);
+    defncyearvar("HARVEST_VH1", NC_DOUBLE, RANK_HARVEST_VH1, HARVEST_VH1_dims, &HARVEST_VH1_id);
 
     HARVEST_VH2_dims[0] = lat_dim;
     HARVEST_VH2_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "HARVEST_VH2", NC_DOUBLE, RANK_HARVEST_VH2, HARVEST_VH2_dims, &HARVEST_VH2_id);
-    check_err(stat,__LINE__,__FILE__);
+    defncyearvar("HARVEST_VH2", NC_DOUBLE, RANK_HARVEST_VH2, HARVEST_VH2_dims, &HARVEST_VH2_id);
 
     HARVEST_SH1_dims[0] = lat_dim;
     HARVEST_SH1_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "HARVEST_SH1", NC_DOUBLE, RANK_HARVEST_SH1, HARVEST_SH1_dims, &HARVEST_SH1_id);
-    check_err(stat,__LINE__,__FILE__);
+    defncyearvar("HARVEST_SH1", NC_DOUBLE, RANK_HARVEST_SH1, HARVEST_SH1_dims, &HARVEST_SH1_id);
 
     HARVEST_SH2_dims[0] = lat_dim;
     HARVEST_SH2_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "HARVEST_SH2", NC_DOUBLE, RANK_HARVEST_SH2, HARVEST_SH2_dims, &HARVEST_SH2_id);
-    check_err(stat,__LINE__,__FILE__);
+    defncyearvar("HARVEST_SH2", NC_DOUBLE, RANK_HARVEST_SH2, HARVEST_SH2_dims, &HARVEST_SH2_id);
 
     HARVEST_SH3_dims[0] = lat_dim;
     HARVEST_SH3_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "HARVEST_SH3", NC_DOUBLE, RANK_HARVEST_SH3, HARVEST_SH3_dims, &HARVEST_SH3_id);
-    check_err(stat,__LINE__,__FILE__);
+    defncyearvar("HARVEST_SH3", NC_DOUBLE, RANK_HARVEST_SH3, HARVEST_SH3_dims, &HARVEST_SH3_id);
 
     GRAZING_dims[0] = lat_dim;
     GRAZING_dims[1] = lon_dim;
-    stat = nc_def_var(ncid, "GRAZING", NC_DOUBLE, RANK_GRAZING, GRAZING_dims, &GRAZING_id);
-    check_err(stat,__LINE__,__FILE__);
+    defncyearvar("GRAZING", NC_DOUBLE, RANK_GRAZING, GRAZING_dims, &GRAZING_id);
 
     UNREPRESENTED_PFT_LULCC_dims[0] = natpft_dim;
     UNREPRESENTED_PFT_LULCC_dims[1] = lat_dim;
     UNREPRESENTED_PFT_LULCC_dims[2] = lon_dim;
-    stat = nc_def_var(ncid, "UNREPRESENTED_PFT_LULCC", NC_DOUBLE, RANK_UNREPRESENTED_PFT_LULCC, UNREPRESENTED_PFT_LULCC_dims, &UNREPRESENTED_PFT_LULCC_id);
-    check_err(stat,__LINE__,__FILE__);
+    defncyearvar("UNREPRESENTED_PFT_LULCC", NC_DOUBLE, RANK_UNREPRESENTED_PFT_LULCC, UNREPRESENTED_PFT_LULCC_dims, &UNREPRESENTED_PFT_LULCC_id);
 
     UNREPRESENTED_CFT_LULCC_dims[0] = cft_dim;
     UNREPRESENTED_CFT_LULCC_dims[1] = lat_dim;
     UNREPRESENTED_CFT_LULCC_dims[2] = lon_dim;
-    stat = nc_def_var(ncid, "UNREPRESENTED_CFT_LULCC", NC_DOUBLE, RANK_UNREPRESENTED_CFT_LULCC, UNREPRESENTED_CFT_LULCC_dims, &UNREPRESENTED_CFT_LULCC_id);
-    check_err(stat,__LINE__,__FILE__);
+    defncyearvar("UNREPRESENTED_CFT_LULCC", NC_DOUBLE, RANK_UNREPRESENTED_CFT_LULCC, UNREPRESENTED_CFT_LULCC_dims, &UNREPRESENTED_CFT_LULCC_id);
 
     /* assign global attributes */
 
     {
-    stat = nc_put_att_text(ncid, NC_GLOBAL, "source", 20, "Peter Lawrence, NCAR");
+    stat = nc_put_att_text(outncid, NC_GLOBAL, "source", 20, "Peter Lawrence, NCAR");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, NC_GLOBAL, "creation_date", 28, "Tue Jun 13 16:42:45 MDT 2017");
+    stat = nc_put_att_text(outncid, NC_GLOBAL, "creation_date", 28, "Tue Jun 13 16:42:45 MDT 2017");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, NC_GLOBAL, "title", 18, "mksrf_file.nc");
+    stat = nc_put_att_text(outncid, NC_GLOBAL, "title", 18, "mksrf_file.nc");
     check_err(stat,__LINE__,__FILE__);
     }
 
@@ -956,434 +1902,448 @@ createncoutputfile(char *netcdffilename) {
     /* assign per-variable attributes */
 
     {
-    stat = nc_put_att_text(ncid, natpft_id, "long_name", 23, "indices of natural PFTs");
+    stat = nc_put_att_text(outncid, natpft_id, "long_name", 23, "indices of natural PFTs");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, natpft_id, "units", 5, "index");
+    stat = nc_put_att_text(outncid, natpft_id, "units", 5, "index");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, cft_id, "long_name", 15, "indices of CFTs");
+    stat = nc_put_att_text(outncid, cft_id, "long_name", 15, "indices of CFTs");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, cft_id, "units", 5, "index");
+    stat = nc_put_att_text(outncid, cft_id, "units", 5, "index");
+    check_err(stat,__LINE__,__FILE__);
+    }
+
+    if (outputtimeseries > 0) {
+    stat = nc_put_att_text(outncid, YEAR_id, "long_name", 4, "year");
+    check_err(stat,__LINE__,__FILE__);
+    stat = nc_put_att_text(outncid, YEAR_id, "units", 8, "year AD");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, EDGEN_id, "long_name", 29, "northern edge of surface grid");
+    stat = nc_put_att_text(outncid, EDGEN_id, "long_name", 29, "northern edge of surface grid");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, EDGEN_id, "units", 13, "degrees north");
+    stat = nc_put_att_text(outncid, EDGEN_id, "units", 13, "degrees north");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, EDGEE_id, "long_name", 28, "eastern edge of surface grid");
+    stat = nc_put_att_text(outncid, EDGEE_id, "long_name", 28, "eastern edge of surface grid");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, EDGEE_id, "units", 12, "degrees east");
+    stat = nc_put_att_text(outncid, EDGEE_id, "units", 12, "degrees east");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, EDGES_id, "long_name", 29, "southern edge of surface grid");
+    stat = nc_put_att_text(outncid, EDGES_id, "long_name", 29, "southern edge of surface grid");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, EDGES_id, "units", 13, "degrees north");
+    stat = nc_put_att_text(outncid, EDGES_id, "units", 13, "degrees north");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, EDGEW_id, "long_name", 28, "western edge of surface grid");
+    stat = nc_put_att_text(outncid, EDGEW_id, "long_name", 28, "western edge of surface grid");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, EDGEW_id, "units", 12, "degrees east");
+    stat = nc_put_att_text(outncid, EDGEW_id, "units", 12, "degrees east");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, LAT_id, "long_name", 3, "lat");
+    stat = nc_put_att_text(outncid, LAT_id, "long_name", 3, "lat");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, LAT_id, "units", 13, "degrees north");
+    stat = nc_put_att_text(outncid, LAT_id, "units", 13, "degrees north");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
     static const float mksrf_file__FillValue_att[1] = {((float)9.96921e+36)} ;
-    stat = nc_put_att_float(ncid, LATIXY_id, "_FillValue", NC_FLOAT, 1, mksrf_file__FillValue_att);
+    stat = nc_put_att_float(outncid, LATIXY_id, "_FillValue", NC_FLOAT, 1, mksrf_file__FillValue_att);
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, LATIXY_id, "long_name", 11, "latitude-2d");
+    stat = nc_put_att_text(outncid, LATIXY_id, "long_name", 11, "latitude-2d");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, LATIXY_id, "units", 13, "degrees north");
+    stat = nc_put_att_text(outncid, LATIXY_id, "units", 13, "degrees north");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, LON_id, "long_name", 3, "lon");
+    stat = nc_put_att_text(outncid, LON_id, "long_name", 3, "lon");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, LON_id, "units", 12, "degrees east");
+    stat = nc_put_att_text(outncid, LON_id, "units", 12, "degrees east");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
     static const float mksrf_file__FillValue_att[1] = {((float)9.96921e+36)} ;
-    stat = nc_put_att_float(ncid, LONGXY_id, "_FillValue", NC_FLOAT, 1, mksrf_file__FillValue_att);
+    stat = nc_put_att_float(outncid, LONGXY_id, "_FillValue", NC_FLOAT, 1, mksrf_file__FillValue_att);
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, LONGXY_id, "long_name", 12, "longitude-2d");
+    stat = nc_put_att_text(outncid, LONGXY_id, "long_name", 12, "longitude-2d");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, LONGXY_id, "units", 12, "degrees east");
+    stat = nc_put_att_text(outncid, LONGXY_id, "units", 12, "degrees east");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, LANDMASK_id, "long_name", 9, "land mask");
+    stat = nc_put_att_text(outncid, LANDMASK_id, "long_name", 9, "land mask");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, LANDMASK_id, "units", 8, "unitless");
+    stat = nc_put_att_text(outncid, LANDMASK_id, "units", 8, "unitless");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, LANDFRAC_id, "long_name", 25, "land fraction of gridcell");
+    stat = nc_put_att_text(outncid, LANDFRAC_id, "long_name", 25, "land fraction of gridcell");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, LANDFRAC_id, "units", 8, "unitless");
+    stat = nc_put_att_text(outncid, LANDFRAC_id, "units", 8, "unitless");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, AREA_id, "long_name", 16, "area of gridcell");
+    stat = nc_put_att_text(outncid, AREA_id, "long_name", 16, "area of gridcell");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, AREA_id, "units", 4, "km^2");
+    stat = nc_put_att_text(outncid, AREA_id, "units", 4, "km^2");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, PCT_GLACIER_id, "long_name", 30, "total percent glacier landunit");
+    stat = nc_put_att_text(outncid, PCT_GLACIER_id, "long_name", 30, "total percent glacier landunit");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, PCT_GLACIER_id, "units", 8, "unitless");
+    stat = nc_put_att_text(outncid, PCT_GLACIER_id, "units", 8, "unitless");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
     static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, PCT_GLACIER_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    stat = nc_put_att_double(outncid, PCT_GLACIER_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, PCT_LAKE_id, "long_name", 27, "total percent lake landunit");
+    stat = nc_put_att_text(outncid, PCT_LAKE_id, "long_name", 27, "total percent lake landunit");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, PCT_LAKE_id, "units", 8, "unitless");
+    stat = nc_put_att_text(outncid, PCT_LAKE_id, "units", 8, "unitless");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
     static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, PCT_LAKE_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    stat = nc_put_att_double(outncid, PCT_LAKE_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, PCT_WETLAND_id, "long_name", 30, "total percent wetland landunit");
+    stat = nc_put_att_text(outncid, PCT_WETLAND_id, "long_name", 30, "total percent wetland landunit");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, PCT_WETLAND_id, "units", 8, "unitless");
+    stat = nc_put_att_text(outncid, PCT_WETLAND_id, "units", 8, "unitless");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
     static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, PCT_WETLAND_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    stat = nc_put_att_double(outncid, PCT_WETLAND_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, PCT_URBAN_id, "long_name", 28, "total percent urban landunit");
+    stat = nc_put_att_text(outncid, PCT_URBAN_id, "long_name", 28, "total percent urban landunit");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, PCT_URBAN_id, "units", 8, "unitless");
+    stat = nc_put_att_text(outncid, PCT_URBAN_id, "units", 8, "unitless");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
     static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, PCT_URBAN_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    stat = nc_put_att_double(outncid, PCT_URBAN_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, PCT_NATVEG_id, "long_name", 41, "total percent natural vegetation landunit");
+    stat = nc_put_att_text(outncid, PCT_NATVEG_id, "long_name", 41, "total percent natural vegetation landunit");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, PCT_NATVEG_id, "units", 8, "unitless");
+    stat = nc_put_att_text(outncid, PCT_NATVEG_id, "units", 8, "unitless");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
     static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, PCT_NATVEG_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    stat = nc_put_att_double(outncid, PCT_NATVEG_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, PCT_CROP_id, "long_name", 27, "total percent crop landunit");
+    stat = nc_put_att_text(outncid, PCT_CROP_id, "long_name", 27, "total percent crop landunit");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, PCT_CROP_id, "units", 8, "unitless");
+    stat = nc_put_att_text(outncid, PCT_CROP_id, "units", 8, "unitless");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
     static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, PCT_CROP_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    stat = nc_put_att_double(outncid, PCT_CROP_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, PCT_NAT_PFT_id, "long_name", 73, "percent plant functional type on the natural veg landunit (% of landunit)");
+    stat = nc_put_att_text(outncid, PCT_NAT_PFT_id, "long_name", 73, "percent plant functional type on the natural veg landunit (% of landunit)");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, PCT_NAT_PFT_id, "units", 8, "unitless");
+    stat = nc_put_att_text(outncid, PCT_NAT_PFT_id, "units", 8, "unitless");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
     static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, PCT_NAT_PFT_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    stat = nc_put_att_double(outncid, PCT_NAT_PFT_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, PCT_CFT_id, "long_name", 65, "percent crop functional type on the crop landunit (% of landunit)");
+    stat = nc_put_att_text(outncid, PCT_CFT_id, "long_name", 65, "percent crop functional type on the crop landunit (% of landunit)");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, PCT_CFT_id, "units", 8, "unitless");
+    stat = nc_put_att_text(outncid, PCT_CFT_id, "units", 8, "unitless");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
     static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, PCT_CFT_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    stat = nc_put_att_double(outncid, PCT_CFT_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, FERTNITRO_CFT_id, "long_name", 33, "nitrogen fertilizer for each crop");
+    stat = nc_put_att_text(outncid, FERTNITRO_CFT_id, "long_name", 33, "nitrogen fertilizer for each crop");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, FERTNITRO_CFT_id, "units", 8, "gN/m2/yr");
+    stat = nc_put_att_text(outncid, FERTNITRO_CFT_id, "units", 8, "gN/m2/yr");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
     static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, FERTNITRO_CFT_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    stat = nc_put_att_double(outncid, FERTNITRO_CFT_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, HARVEST_VH1_id, "long_name", 27, "harvest from primary forest");
+    stat = nc_put_att_text(outncid, HARVEST_VH1_id, "long_name", 27, "harvest from primary forest");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, HARVEST_VH1_id, "units", 8, "gC/m2/yr");
+    stat = nc_put_att_text(outncid, HARVEST_VH1_id, "units", 8, "gC/m2/yr");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
     static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, HARVEST_VH1_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    stat = nc_put_att_double(outncid, HARVEST_VH1_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, HARVEST_VH2_id, "long_name", 31, "harvest from primary non-forest");
+    stat = nc_put_att_text(outncid, HARVEST_VH2_id, "long_name", 31, "harvest from primary non-forest");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, HARVEST_VH2_id, "units", 8, "gC/m2/yr");
+    stat = nc_put_att_text(outncid, HARVEST_VH2_id, "units", 8, "gC/m2/yr");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
     static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, HARVEST_VH2_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    stat = nc_put_att_double(outncid, HARVEST_VH2_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, HARVEST_SH1_id, "long_name", 36, "harvest from secondary mature-forest");
+    stat = nc_put_att_text(outncid, HARVEST_SH1_id, "long_name", 36, "harvest from secondary mature-forest");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, HARVEST_SH1_id, "units", 8, "gC/m2/yr");
+    stat = nc_put_att_text(outncid, HARVEST_SH1_id, "units", 8, "gC/m2/yr");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
     static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, HARVEST_SH1_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    stat = nc_put_att_double(outncid, HARVEST_SH1_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, HARVEST_SH2_id, "long_name", 35, "harvest from secondary young-forest");
+    stat = nc_put_att_text(outncid, HARVEST_SH2_id, "long_name", 35, "harvest from secondary young-forest");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, HARVEST_SH2_id, "units", 8, "gC/m2/yr");
+    stat = nc_put_att_text(outncid, HARVEST_SH2_id, "units", 8, "gC/m2/yr");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
     static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, HARVEST_SH2_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    stat = nc_put_att_double(outncid, HARVEST_SH2_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, HARVEST_SH3_id, "long_name", 33, "harvest from secondary non-forest");
+    stat = nc_put_att_text(outncid, HARVEST_SH3_id, "long_name", 33, "harvest from secondary non-forest");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, HARVEST_SH3_id, "units", 8, "gC/m2/yr");
+    stat = nc_put_att_text(outncid, HARVEST_SH3_id, "units", 8, "gC/m2/yr");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
     static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, HARVEST_SH3_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    stat = nc_put_att_double(outncid, HARVEST_SH3_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, GRAZING_id, "long_name", 25, "grazing of herbacous pfts");
+    stat = nc_put_att_text(outncid, GRAZING_id, "long_name", 25, "grazing of herbacous pfts");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, GRAZING_id, "units", 8, "gC/m2/yr");
+    stat = nc_put_att_text(outncid, GRAZING_id, "units", 8, "gC/m2/yr");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
     static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, GRAZING_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    stat = nc_put_att_double(outncid, GRAZING_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, UNREPRESENTED_PFT_LULCC_id, "long_name", 41, "unrepresented PFT gross LULCC transitions");
+    stat = nc_put_att_text(outncid, UNREPRESENTED_PFT_LULCC_id, "long_name", 41, "unrepresented PFT gross LULCC transitions");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, UNREPRESENTED_PFT_LULCC_id, "units", 8, "unitless");
+    stat = nc_put_att_text(outncid, UNREPRESENTED_PFT_LULCC_id, "units", 8, "unitless");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
     static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, UNREPRESENTED_PFT_LULCC_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    stat = nc_put_att_double(outncid, UNREPRESENTED_PFT_LULCC_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, UNREPRESENTED_CFT_LULCC_id, "long_name", 42, "unrepresented crop gross LULCC transitions");
+    stat = nc_put_att_text(outncid, UNREPRESENTED_CFT_LULCC_id, "long_name", 42, "unrepresented crop gross LULCC transitions");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
-    stat = nc_put_att_text(ncid, UNREPRESENTED_CFT_LULCC_id, "units", 8, "unitless");
+    stat = nc_put_att_text(outncid, UNREPRESENTED_CFT_LULCC_id, "units", 8, "unitless");
     check_err(stat,__LINE__,__FILE__);
     }
 
     {
     static const double mksrf_file__FillValue_att[1] = {((double)-9999)} ;
-    stat = nc_put_att_double(ncid, UNREPRESENTED_CFT_LULCC_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
+    stat = nc_put_att_double(outncid, UNREPRESENTED_CFT_LULCC_id, "_FillValue", NC_DOUBLE, 1, mksrf_file__FillValue_att);
     check_err(stat,__LINE__,__FILE__);
     }
 
 
     /* leave define mode */
-    stat = nc_enddef (ncid);
+    stat = nc_enddef (outncid);
     check_err(stat,__LINE__,__FILE__);
 
-    /* assign variable data */
+    /* file is left open for the variable data - writegrids closes it with closencoutputfile */
 
-    stat = nc_close(ncid);
-    check_err(stat,__LINE__,__FILE__);
     return 0;
 }
 
 int
 closencfile() {
 
+    int poolindex;
+    int stat;
+
+    for (poolindex = 0; poolindex < ncinputpoolsize; poolindex++) {
+        if (ncinputpoolid[poolindex] == ncid) {
+            return 0;
+        }
+    }
+
     stat = nc_close(ncid);
     check_err(stat,__LINE__,__FILE__);
 
@@ -1391,29 +2351,202 @@ closencfile() {
 
 }
 
+int
+closencoutputfile() {
+
+    int stat;
+
+    stat = nc_close(outncid);
+    check_err(stat,__LINE__,__FILE__);
+
+    return 0;
+
+}
+
+int
+closencinputpool() {
+
+    int poolindex;
+    int stat;
+
+    for (poolindex = 0; poolindex < ncinputpoolsize; poolindex++) {
+        stat = nc_close(ncinputpoolid[poolindex]);
+        check_err(stat,__LINE__,__FILE__);
+    }
+    ncinputpoolsize = 0;
+
+    return 0;
+
+}
+
+double phaseclocktime(clockid_t clockid) {
+
+  struct timespec clocknow;
+
+  clock_gettime(clockid, &clocknow);
+
+  return clocknow.tv_sec + clocknow.tv_nsec * 1.0e-9;
+
+}
+
+int createphasetimings() {
+
+  phasetimings = (phasetiming *) calloc((endyear - startyear + 2) * PHASES, sizeof(phasetiming));
+
+  return 0;
+
+}
+
+int startphase(phaseclock *clock) {
+
+  clock->wallstart = phaseclocktime(CLOCK_MONOTONIC);
+  clock->cpustart = phaseclocktime(CLOCK_THREAD_CPUTIME_ID);
+  clock->bytesreadstart = threadbytesread;
+  clock->byteswrittenstart = threadbyteswritten;
+
+  return 0;
+
+}
+
+int endphase(phaseclock *clock, int phase, int yearnumber, long pixels, int countwall) {
+
+  /* add what the calling thread spent since startphase to a phase of a year (PHASEYEAR_TILE for the per tile */
+  /* reads) - kernel threads only add their CPU time and bytes since their worker times the year's wall clock */
+
+  phasetiming *timing;
+  double wallend, cpuend;
+
+  wallend = phaseclocktime(CLOCK_MONOTONIC);
+  cpuend = phaseclocktime(CLOCK_THREAD_CPUTIME_ID);
+
+  timing = &phasetimings[phase];
+  if (yearnumber != PHASEYEAR_TILE) {
+      timing = &phasetimings[(yearnumber - startyear + 1) * PHASES + phase];
+  }
+
+  pthread_mutex_lock(&phasetimingmutex);
+  if (countwall == 1) {
+      timing->wallseconds += wallend - clock->wallstart;
+  }
+  timing->cpuseconds += cpuend - clock->cpustart;
+  timing->bytesread += threadbytesread - clock->bytesreadstart;
+  timing->byteswritten += threadbyteswritten - clock->byteswrittenstart;
+  timing->pixels += pixels;
+  pthread_mutex_unlock(&phasetimingmutex);
+
+  return 0;
+
+}
+
+int writephasetiming(FILE *timingfile, char *yearlabel, int phase, phasetiming *timing) {
+
+  double pixelrate;
+
+  pixelrate = 0.0;
+  if (timing->wallseconds > 0.0) {
+      pixelrate = timing->pixels / timing->wallseconds;
+  }
+  fprintf(timingfile,"%s,%s,%.6f,%.6f,%ld,%ld,%ld,%.1f\n",yearlabel,phasenames[phase],timing->wallseconds,timing->cpuseconds,
+          timing->bytesread,timing->byteswritten,timing->pixels,pixelrate);
+
+  return 0;
+
+}
+
+int writephasetimings() {
+
+  /* one row per phase per year, the tile reads as year "tile" and the sums over the years and tiles as "total" - */
+  /* each MPI rank writes its own file */
+
+  FILE *timingfile;
+  char timingfilename[1100];
+  char yearlabel[32];
+  phasetiming totals[PHASES];
+  phasetiming *timing;
+  int yearnumber, phase;
+
+  if (mpisize > 1) {
+      sprintf(timingfilename,"%s/%s_timing_rank%d.csv",outputdir,outputseries,mpirank);
+  }
+  else {
+      sprintf(timingfilename,"%s/%s_timing.csv",outputdir,outputseries);
+  }
+
+  printf("Writing %s\n",timingfilename);
+  timingfile = fopen(timingfilename,"w");
+  if (timingfile == NULL) {
+      printf("Unable to write timing report: %s\n",timingfilename);
+      return 1;
+  }
+
+  fprintf(timingfile,"year,phase,wall_seconds,cpu_seconds,bytes_read,bytes_written,pixels,pixels_per_second\n");
+
+  memset(totals, 0, sizeof(totals));
+  for (yearnumber = startyear - 1; yearnumber <= endyear; yearnumber++) {
+      if (yearnumber < startyear) {
+          sprintf(yearlabel,"tile");
+      }
+      else {
+          sprintf(yearlabel,"%d",yearnumber);
+      }
+      for (phase = 0; phase < PHASES; phase++) {
+          timing = &phasetimings[(yearnumber - startyear + 1) * PHASES + phase];
+          if (timing->wallseconds == 0.0 && timing->cpuseconds == 0.0) {
+              continue;
+          }
+          writephasetiming(timingfile,yearlabel,phase,timing);
+          totals[phase].wallseconds += timing->wallseconds;
+          totals[phase].cpuseconds += timing->cpuseconds;
+          totals[phase].bytesread += timing->bytesread;
+          totals[phase].byteswritten += timing->byteswritten;
+          totals[phase].pixels += timing->pixels;
+      }
+  }
+
+  for (phase = 0; phase < PHASES; phase++) {
+      if (totals[phase].wallseconds == 0.0 && totals[phase].cpuseconds == 0.0) {
+          continue;
+      }
+      writephasetiming(timingfile,"total",phase,&totals[phase]);
+  }
+
+  fclose(timingfile);
+
+  return 0;
+
+}
+
 int readnc0dfield(char *FieldName, float *targetvalue) {
 
     int varid;
+    int stat;
         
     stat =  nc_inq_varid(ncid, FieldName, &varid);
     check_err(stat,__LINE__,__FILE__);
 
     stat =  nc_get_var_float(ncid, varid, targetvalue);
     check_err(stat,__LINE__,__FILE__);
+    threadbytesread += sizeof(float);
     
     return 0;
 
 }
 
-int readnc1dfield(char *FieldName, float *targetarray) {
+int readnc1dfield(char *FieldName, float *targetarray, long offset1d, long count1d) {
 
     int varid;
+    int stat;
+    size_t start[1], count[1];
+    
+    count[0] = count1d;
+    start[0] = offset1d;
     
     stat =  nc_inq_varid(ncid, FieldName, &varid);
     check_err(stat,__LINE__,__FILE__);
 
-    stat =  nc_get_var_float(ncid, varid, targetarray);
+    stat =  nc_get_vara_float(ncid, varid, start, count, targetarray);
     check_err(stat,__LINE__,__FILE__);
+    threadbytesread += count1d * sizeof(float);
     
     return 0;
 
@@ -1422,6 +2555,7 @@ int readnc1dfield(char *FieldName, float *targetarray) {
 int readnc1dintfield(char *FieldName, int *targetarray) {
 
     int varid;
+    int stat;
     
     stat =  nc_inq_varid(ncid, FieldName, &varid);
     check_err(stat,__LINE__,__FILE__);
@@ -1433,27 +2567,70 @@ int readnc1dintfield(char *FieldName, int *targetarray) {
 
 }
 
+int flipgridrows(float *targetgrid) {
+
+    /* swap north up rows into south up order in place using the calling thread's row of scratch instead of a */
+    /* shared flip grid */
+
+    long clmlin, fliplin;
+    long rowsize;
+
+    rowsize = MAXOUTPIX * sizeof(float);
+    if (fliprowpix < MAXOUTPIX) {
+        free(fliprow);
+        fliprow = (float *) malloc(rowsize);
+        if (fliprow == NULL) {
+            printf("Unable to allocate a flip row of %ld pixels\n",MAXOUTPIX);
+            exit(1);
+        }
+        fliprowpix = MAXOUTPIX;
+    }
+
+    for (clmlin = 0; clmlin < MAXOUTLIN / 2; clmlin++) {
+        fliplin = MAXOUTLIN - clmlin - 1;
+        memcpy(fliprow, &targetgrid[clmlin * MAXOUTPIX], rowsize);
+        memcpy(&targetgrid[clmlin * MAXOUTPIX], &targetgrid[fliplin * MAXOUTPIX], rowsize);
+        memcpy(&targetgrid[fliplin * MAXOUTPIX], fliprow, rowsize);
+    }
+
+    return 0;
+
+}
+
+int freefliprow() {
+
+    free(fliprow);
+    fliprow = NULL;
+    fliprowpix = 0;
+
+    return 0;
+
+}
+
 int readnc2dfield(char *FieldName, float *targetgrid, int flipgrid) {
 
     int varid;
-    long clmlin, clmpix, fliplin;
+    int stat;
+    size_t start[2], count[2];
+    
+    count[0] = MAXOUTLIN;
+    count[1] = MAXOUTPIX;
+    start[0] = OUTSOUTHLATOFFSET;
+    start[1] = OUTLONOFFSET;
     
     stat =  nc_inq_varid(ncid, FieldName, &varid);
     check_err(stat,__LINE__,__FILE__);
 
-    if (flipgrid == 0) {
-        stat =  nc_get_var_float(ncid, varid, targetgrid);
-        check_err(stat,__LINE__,__FILE__);
+    if (flipgrid != 0) {
+        start[0] = OUTLATOFFSET;
     }
-    else {
-        stat =  nc_get_var_float(ncid, varid, tempflipGrid);
-        check_err(stat,__LINE__,__FILE__);
-        for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-            fliplin = MAXOUTLIN - clmlin - 1;
-            for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-                targetgrid[clmlin * MAXOUTPIX + clmpix] = tempflipGrid[fliplin * MAXOUTPIX + clmpix];
-            }
-	}
+
+    stat =  nc_get_vara_float(ncid, varid, start, count, targetgrid);
+    check_err(stat,__LINE__,__FILE__);
+    threadbytesread += OUTDATASIZE;
+
+    if (flipgrid != 0) {
+        flipgridrows(targetgrid);
     }
     
     return 0;
@@ -1464,147 +2641,236 @@ int readnc2dfield(char *FieldName, float *targetgrid, int flipgrid) {
 int readnc3dfield(char *FieldName, int index3d, float *targetgrid, int flipgrid) {
 
     int varid;
-    long clmlin, clmpix, fliplin;
+    int stat;
     size_t start[3], count[3];
     
     count[0] = 1;
     count[1] = MAXOUTLIN;
     count[2] = MAXOUTPIX;
     start[0] = index3d;
-    start[1] = 0;
-    start[2] = 0;
+    start[1] = OUTSOUTHLATOFFSET;
+    start[2] = OUTLONOFFSET;
     
     stat =  nc_inq_varid(ncid, FieldName, &varid);
     check_err(stat,__LINE__,__FILE__);
 
-    if (flipgrid == 0) {
-        stat =  nc_get_vara_float(ncid, varid, start, count, targetgrid);
-        check_err(stat,__LINE__,__FILE__);
+    if (flipgrid != 0) {
+        start[1] = OUTLATOFFSET;
     }
-    else {
-        stat =  nc_get_vara_float(ncid, varid, start, count, tempflipGrid);
-        check_err(stat,__LINE__,__FILE__);
-        for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-            fliplin = MAXOUTLIN - clmlin - 1;
-            for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-                targetgrid[clmlin * MAXOUTPIX + clmpix] = tempflipGrid[fliplin * MAXOUTPIX + clmpix];
-            }
-	}
+
+    stat =  nc_get_vara_float(ncid, varid, start, count, targetgrid);
+    check_err(stat,__LINE__,__FILE__);
+    threadbytesread += OUTDATASIZE;
+
+    if (flipgrid != 0) {
+        flipgridrows(targetgrid);
     }
         
     return 0;
     
 }
 
-int writenc0dfield(char *FieldName, float *targetvalue) {
+int transposeband(float *planeband, float *pixelblock, int blockcount, long bandstart, long bandsize) {
 
-    int varid;
-    
-    stat =  nc_inq_varid(ncid, FieldName, &varid);
-    check_err(stat,__LINE__,__FILE__);
+    /* plane major [type][pixel] of a band of pixels as read from netCDF to pixel major [pixel][type] */
+
+    long bandpix;
+    int blockid;
+
+    for (bandpix = 0; bandpix < bandsize; bandpix++) {
+        for (blockid = 0; blockid < blockcount; blockid++) {
+            pixelblock[(bandstart + bandpix) * blockcount + blockid] = planeband[blockid * bandsize + bandpix];
+        }
+    }
 
-    stat =  nc_put_var_float(ncid, varid, targetvalue);
-    check_err(stat,__LINE__,__FILE__);
-    
     return 0;
 
 }
 
-int writenc1dfield(char *FieldName, float *targetarray) {
+int readnc3dblockfield(char *FieldName, int count3d, float *targetblock) {
 
     int varid;
+    int stat;
+    size_t start[3], count[3];
+    float *readband;
+    long bandlin, clmlin;
+    
+    count[0] = count3d;
+    count[1] = MAXOUTLIN;
+    count[2] = MAXOUTPIX;
+    start[0] = 0;
+    start[1] = OUTSOUTHLATOFFSET;
+    start[2] = OUTLONOFFSET;
     
     stat =  nc_inq_varid(ncid, FieldName, &varid);
     check_err(stat,__LINE__,__FILE__);
 
-    stat =  nc_put_var_float(ncid, varid, targetarray);
+    if (pixelmajorgrids != 1) {
+        stat =  nc_get_vara_float(ncid, varid, start, count, targetblock);
+        check_err(stat,__LINE__,__FILE__);
+        threadbytesread += OUTDATASIZE * count3d;
+        return 0;
+    }
+
+    /* pixel major blocks are read plane major a band of rows at a time into a scratch of at most TRANSPOSEBANDBYTES */
+    /* and scattered into the block, so the transpose never holds a second copy of the whole cube */
+
+    bandlin = TRANSPOSEBANDBYTES / (count3d * MAXOUTPIX * sizeof(float));
+    if (bandlin < 1) {
+        bandlin = 1;
+    }
+    if (bandlin > MAXOUTLIN) {
+        bandlin = MAXOUTLIN;
+    }
+
+    readband = (float *) malloc(count3d * bandlin * MAXOUTPIX * sizeof(float));
+    if (readband == NULL) {
+        printf("Unable to allocate %ld rows of %s to transpose\n",bandlin,FieldName);
+        exit(1);
+    }
+
+    for (clmlin = 0; clmlin < MAXOUTLIN; clmlin += bandlin) {
+        if (clmlin + bandlin > MAXOUTLIN) {
+            bandlin = MAXOUTLIN - clmlin;
+        }
+        start[1] = OUTSOUTHLATOFFSET + clmlin;
+        count[1] = bandlin;
+
+        stat =  nc_get_vara_float(ncid, varid, start, count, readband);
+        check_err(stat,__LINE__,__FILE__);
+        threadbytesread += count3d * bandlin * MAXOUTPIX * sizeof(float);
+
+        transposeband(readband,targetblock,count3d,clmlin * MAXOUTPIX,bandlin * MAXOUTPIX);
+    }
+
+    free(readband);
+        
+    return 0;
+    
+}
+
+int writenc0dfield(int varid, float *targetvalue) {
+
+    int stat;
+    stat =  nc_put_var_float(outncid, varid, targetvalue);
     check_err(stat,__LINE__,__FILE__);
+    threadbyteswritten += sizeof(float);
     
     return 0;
 
 }
 
-int writenc1dintfield(char *FieldName, int *targetarray) {
+int writenc1dfield(int varid, float *targetarray, long offset1d, long count1d) {
 
-    int varid;
+    int stat;
+    size_t start[1], count[1];
     
-    stat =  nc_inq_varid(ncid, FieldName, &varid);
+    count[0] = count1d;
+    start[0] = offset1d;
+    
+    stat =  nc_put_vara_float(outncid, varid, start, count, targetarray);
     check_err(stat,__LINE__,__FILE__);
+    threadbyteswritten += count1d * sizeof(float);
+    
+    return 0;
+
+}
 
-    stat =  nc_put_var_int(ncid, varid, targetarray);
+int writenc1dintfield(int varid, int *targetarray) {
+
+    int stat;
+    stat =  nc_put_var_int(outncid, varid, targetarray);
     check_err(stat,__LINE__,__FILE__);
     
     return 0;
 
 }
 
-int writenc2dfield(char *FieldName, float *targetgrid) {
+int writenc2dfield(int varid, float *targetgrid) {
 
-    int varid;
+    int stat;
+    size_t start[2], count[2];
     
-    stat =  nc_inq_varid(ncid, FieldName, &varid);
-    check_err(stat,__LINE__,__FILE__);
-
-    stat =  nc_put_var_float(ncid, varid, targetgrid);
+    count[0] = MAXOUTLIN;
+    count[1] = MAXOUTPIX;
+    start[0] = OUTBANDLATOFFSET;
+    start[1] = 0;
+    
+    stat =  nc_put_vara_float(outncid, varid, start, count, targetgrid);
     check_err(stat,__LINE__,__FILE__);
+    threadbyteswritten += OUTDATASIZE;
     
     return 0;
 
 }
 
-int writenc3dfield(char *FieldName, int index3d, float *targetgrid) {
+int writenc3dfield(int varid, int index3d, float *targetgrid) {
 
-    int varid;
+    int stat;
     size_t start[3], count[3];
     
     count[0] = 1;
     count[1] = MAXOUTLIN;
     count[2] = MAXOUTPIX;
     start[0] = index3d;
-    start[1] = 0;
+    start[1] = OUTBANDLATOFFSET;
     start[2] = 0;
         
-    stat =  nc_inq_varid(ncid, FieldName, &varid);
-    check_err(stat,__LINE__,__FILE__);
-
-    stat =  nc_put_vara_float(ncid, varid, start, count, targetgrid);
+    stat =  nc_put_vara_float(outncid, varid, start, count, targetgrid);
     check_err(stat,__LINE__,__FILE__);
+    threadbyteswritten += OUTDATASIZE;
     
     return 0;
     
 }
 
-int writenc2ddblfield(char *FieldName, double *targetgrid) {
+int writenc2ddblfield(int varid, double *targetgrid) {
 
-    int varid;
-    
-    stat =  nc_inq_varid(ncid, FieldName, &varid);
-    check_err(stat,__LINE__,__FILE__);
+    int stat;
+    size_t start[3], count[3];
+    int dimid;
+
+    dimid = 0;
+    if (outputrecord >= 0) {
+        count[dimid] = 1;
+        start[dimid] = outputrecord;
+        dimid++;
+    }
+    count[dimid] = MAXOUTLIN;
+    count[dimid + 1] = MAXOUTPIX;
+    start[dimid] = OUTBANDLATOFFSET;
+    start[dimid + 1] = 0;
 
-    stat =  nc_put_var_double(ncid, varid, targetgrid);
+    stat =  nc_put_vara_double(outncid, varid, start, count, targetgrid);
     check_err(stat,__LINE__,__FILE__);
+    threadbyteswritten += OUTDBLDATASIZE;
     
     return 0;
 
 }
 
-int writenc3ddblfield(char *FieldName, int index3d, double *targetgrid) {
+int writenc3ddblfield(int varid, int index3d, int count3d, double *targetgrid) {
 
-    int varid;
-    size_t start[3], count[3];
+    int stat;
+    size_t start[4], count[4];
+    int dimid;
     
-    count[0] = 1;
-    count[1] = MAXOUTLIN;
-    count[2] = MAXOUTPIX;
-    start[0] = index3d;
-    start[1] = 0;
-    start[2] = 0;
+    dimid = 0;
+    if (outputrecord >= 0) {
+        count[dimid] = 1;
+        start[dimid] = outputrecord;
+        dimid++;
+    }
+    count[dimid] = count3d;
+    count[dimid + 1] = MAXOUTLIN;
+    count[dimid + 2] = MAXOUTPIX;
+    start[dimid] = index3d;
+    start[dimid + 1] = OUTBANDLATOFFSET;
+    start[dimid + 2] = 0;
         
-    stat =  nc_inq_varid(ncid, FieldName, &varid);
-    check_err(stat,__LINE__,__FILE__);
-
-    stat =  nc_put_vara_double(ncid, varid, start, count, targetgrid);
+    stat =  nc_put_vara_double(outncid, varid, start, count, targetgrid);
     check_err(stat,__LINE__,__FILE__);
+    threadbyteswritten += OUTDBLDATASIZE * count3d;
     
     return 0;
     
@@ -1612,8 +2878,6 @@ int writenc3ddblfield(char *FieldName, int index3d, double *targetgrid) {
 
 int readclmcurrentGrids() {
 
-  int pftid, cftid;
-
   openncinputfile(clmcurrentsurfdb);
   
   readnc1dintfield("natpft",innatpft);
@@ -1622,9 +2886,9 @@ int readclmcurrentGrids() {
   readnc0dfield("EDGEE",&inEDGEE);
   readnc0dfield("EDGES",&inEDGES);
   readnc0dfield("EDGEW",&inEDGEW);
-  readnc1dfield("LAT",inLAT);
+  readnc1dfield("LAT",inLAT,OUTSOUTHLATOFFSET,MAXOUTLIN);
   readnc2dfield("LATIXY",inLATIXY,0);
-  readnc1dfield("LON",inLON);
+  readnc1dfield("LON",inLON,OUTLONOFFSET,MAXOUTPIX);
   readnc2dfield("LONGXY",inLONGXY,0);
   readnc2dfield("LANDMASK",inLANDMASKGrid,0);
   readnc2dfield("LANDFRAC",inLANDFRACGrid,0);
@@ -1636,13 +2900,8 @@ int readclmcurrentGrids() {
   readnc2dfield("PCT_NATVEG",inPCTNATVEGGrid,0);
   readnc2dfield("PCT_CROP",inPCTCROPGrid,0);
   
-  for (pftid = 0; pftid < MAXPFT; pftid++) {
-      readnc3dfield("PCT_NAT_PFT",pftid,inCURRENTPCTPFTGrid[pftid],0);
-  }
-  
-  for (cftid = 0; cftid < MAXCFT; cftid++) {
-      readnc3dfield("PCT_CFT",cftid,inCURRENTPCTCFTGrid[cftid],0);
-  }
+  readnc3dblockfield("PCT_NAT_PFT",MAXPFT,inCURRENTPCTPFTGrid[0]);
+  readnc3dblockfield("PCT_CFT",MAXCFT,inCURRENTPCTCFTGrid[0]);
 
   closencfile();
 
@@ -1653,13 +2912,9 @@ int readclmcurrentGrids() {
 
 int readclmLUHforestGrids() {
 
-  int pftid, cftid;
-
   openncinputfile(clmLUHforestdb);  
 
-  for (pftid = 0; pftid < MAXPFT; pftid++) {
-      readnc3dfield("PCT_NAT_PFT",pftid,inFORESTPCTPFTGrid[pftid],0);
-  }
+  readnc3dblockfield("PCT_NAT_PFT",MAXPFT,inFORESTPCTPFTGrid[0]);
   
   closencfile();
   
@@ -1670,13 +2925,9 @@ int readclmLUHforestGrids() {
   
 int readclmLUHpastureGrids() {
 
-  int pftid, cftid;
-
   openncinputfile(clmLUHpasturedb);  
 
-  for (pftid = 0; pftid < MAXPFT; pftid++) {
-      readnc3dfield("PCT_NAT_PFT",pftid,inPASTUREPCTPFTGrid[pftid],0);
-  }
+  readnc3dblockfield("PCT_NAT_PFT",MAXPFT,inPASTUREPCTPFTGrid[0]);
   
   closencfile();
   
@@ -1687,13 +2938,9 @@ int readclmLUHpastureGrids() {
 
 int readclmLUHotherGrids() {
 
-  int pftid, cftid;
-
   openncinputfile(clmLUHotherdb);  
 
-  for (pftid = 0; pftid < MAXPFT; pftid++) {
-      readnc3dfield("PCT_NAT_PFT",pftid,inOTHERPCTPFTGrid[pftid],0);
-  }
+  readnc3dblockfield("PCT_NAT_PFT",MAXPFT,inOTHERPCTPFTGrid[0]);
   
   closencfile();
   
@@ -1703,13 +2950,9 @@ int readclmLUHotherGrids() {
 
 int readclmLUHc3annGrids() {
 
-  int pftid, cftid;
-
   openncinputfile(clmLUHc3anndb);  
 
-  for (cftid = 0; cftid < MAXCFTRAW; cftid++) {
-      readnc3dfield("PCT_CFT",cftid,inC3ANNPCTCFTGrid[cftid],0);
-  }
+  readnc3dblockfield("PCT_CFT",MAXCFTRAW,inC3ANNPCTCFTGrid[0]);
   
   closencfile();
   
@@ -1719,13 +2962,9 @@ int readclmLUHc3annGrids() {
 
 int readclmLUHc4annGrids() {
 
-  int pftid, cftid;
-
   openncinputfile(clmLUHc4anndb);  
 
-  for (cftid = 0; cftid < MAXCFTRAW; cftid++) {
-      readnc3dfield("PCT_CFT",cftid,inC4ANNPCTCFTGrid[cftid],0);
-  }
+  readnc3dblockfield("PCT_CFT",MAXCFTRAW,inC4ANNPCTCFTGrid[0]);
   
   closencfile();
   
@@ -1735,13 +2974,9 @@ int readclmLUHc4annGrids() {
 
 int readclmLUHc3perGrids() {
 
-  int pftid, cftid;
-
   openncinputfile(clmLUHc3perdb);  
 
-  for (cftid = 0; cftid < MAXCFTRAW; cftid++) {
-      readnc3dfield("PCT_CFT",cftid,inC3PERPCTCFTGrid[cftid],0);
-  }
+  readnc3dblockfield("PCT_CFT",MAXCFTRAW,inC3PERPCTCFTGrid[0]);
   
   closencfile();
   
@@ -1751,14 +2986,9 @@ int readclmLUHc3perGrids() {
 
 int readclmLUHc4perGrids() {
 
-  int pftid, cftid;
-  long clmlin, clmpix;
-
   openncinputfile(clmLUHc4perdb);  
 
-  for (cftid = 0; cftid < MAXCFTRAW; cftid++) {
-      readnc3dfield("PCT_CFT",cftid,inC4PERPCTCFTGrid[cftid],0);
-  }
+  readnc3dblockfield("PCT_CFT",MAXCFTRAW,inC4PERPCTCFTGrid[0]);
   
   closencfile();
   
@@ -1768,14 +2998,9 @@ int readclmLUHc4perGrids() {
 
 int readclmLUHc3nfxGrids() {
 
-  int pftid, cftid;
-  long clmlin, clmpix;
-
   openncinputfile(clmLUHc3nfxdb);  
 
-  for (cftid = 0; cftid < MAXCFTRAW; cftid++) {
-      readnc3dfield("PCT_CFT",cftid,inC3NFXPCTCFTGrid[cftid],0);
-  }
+  readnc3dblockfield("PCT_CFT",MAXCFTRAW,inC3NFXPCTCFTGrid[0]);
   
   closencfile();
   
@@ -1784,6 +3009,243 @@ int readclmLUHc3nfxGrids() {
 }
 
 
+int cachereferencefield(void **field, size_t fieldsize) {
+
+  /* place one field at the next page boundary - writes it when building the cache and points it into the mapping */
+  /* otherwise */
+
+  referencecacheoffset = (referencecacheoffset + REFCACHEALIGN - 1) / REFCACHEALIGN * REFCACHEALIGN;
+
+  if (referencecachefile != NULL) {
+      fseek(referencecachefile, referencecacheoffset, SEEK_SET);
+      fwrite(*field, 1, fieldsize, referencecachefile);
+  }
+  else {
+      *field = referencecachebase + referencecacheoffset;
+  }
+  referencecacheoffset += fieldsize;
+
+  return 0;
+
+}
+
+int cachereferenceblock(float **blockgrids, int blockcount) {
+
+  cachereferencefield((void **) &blockgrids[0], OUTDATASIZE * blockcount);
+  setblockgrids(blockgrids,blockgrids[0],blockcount);
+
+  return 0;
+
+}
+
+int cachereferencefields() {
+
+  /* the one field layout shared by writereferencecache and mapreferencecache */
+
+  referencecacheoffset = sizeof(referencecacheheader);
+
+  cachereferencefield((void **) &innatpft, MAXPFT * sizeof(int));
+  cachereferencefield((void **) &incft, MAXCFT * sizeof(int));
+  cachereferencefield((void **) &inLAT, MAXOUTLIN * sizeof(float));
+  cachereferencefield((void **) &inLATIXY, OUTDATASIZE);
+  cachereferencefield((void **) &inLON, MAXOUTPIX * sizeof(float));
+  cachereferencefield((void **) &inLONGXY, OUTDATASIZE);
+  cachereferencefield((void **) &inLANDMASKGrid, OUTDATASIZE);
+  cachereferencefield((void **) &inLANDFRACGrid, OUTDATASIZE);
+  cachereferencefield((void **) &inAREAGrid, OUTDATASIZE);
+  cachereferencefield((void **) &inPCTGLACIERGrid, OUTDATASIZE);
+  cachereferencefield((void **) &inPCTLAKEGrid, OUTDATASIZE);
+  cachereferencefield((void **) &inPCTWETLANDGrid, OUTDATASIZE);
+  cachereferencefield((void **) &inPCTURBANGrid, OUTDATASIZE);
+  cachereferencefield((void **) &inPCTNATVEGGrid, OUTDATASIZE);
+  cachereferencefield((void **) &inPCTCROPGrid, OUTDATASIZE);
+
+  cachereferenceblock(inCURRENTPCTPFTGrid,MAXPFT);
+  cachereferenceblock(inCURRENTPCTCFTGrid,MAXCFT);
+  cachereferenceblock(inFORESTPCTPFTGrid,MAXPFT);
+  cachereferenceblock(inPASTUREPCTPFTGrid,MAXPFT);
+  cachereferenceblock(inOTHERPCTPFTGrid,MAXPFT);
+  cachereferenceblock(inC3ANNPCTCFTGrid,MAXCFTRAW);
+  cachereferenceblock(inC4ANNPCTCFTGrid,MAXCFTRAW);
+  cachereferenceblock(inC3PERPCTCFTGrid,MAXCFTRAW);
+  cachereferenceblock(inC4PERPCTCFTGrid,MAXCFTRAW);
+  cachereferenceblock(inC3NFXPCTCFTGrid,MAXCFTRAW);
+
+  return 0;
+
+}
+
+int setreferencecacheheader(referencecacheheader *header) {
+
+  /* everything a cache has to match to be used - the region, the table sizes and the size and time of every source database */
+
+  char *sourcefiles[REFCACHESOURCES];
+  struct stat sourcestat;
+  int sourceid;
+
+  sourcefiles[0] = clmcurrentsurfdb;
+  sourcefiles[1] = clmLUHforestdb;
+  sourcefiles[2] = clmLUHpasturedb;
+  sourcefiles[3] = clmLUHotherdb;
+  sourcefiles[4] = clmLUHc3anndb;
+  sourcefiles[5] = clmLUHc4anndb;
+  sourcefiles[6] = clmLUHc3perdb;
+  sourcefiles[7] = clmLUHc4perdb;
+  sourcefiles[8] = clmLUHc3nfxdb;
+
+  memset(header, 0, sizeof(referencecacheheader));
+  memcpy(header->magic, REFCACHEMAGIC, 8);
+  header->maxoutpix = MAXOUTPIX;
+  header->maxoutlin = MAXOUTLIN;
+  header->southlatoffset = OUTSOUTHLATOFFSET;
+  header->lonoffset = OUTLONOFFSET;
+  header->maxpft = MAXPFT;
+  header->maxcft = MAXCFT;
+  header->maxcftraw = MAXCFTRAW;
+  header->pixelmajor = pixelmajorgrids;
+
+  for (sourceid = 0; sourceid < REFCACHESOURCES; sourceid++) {
+      strncpy(header->sourcefile[sourceid], sourcefiles[sourceid], 1023);
+      if (stat(sourcefiles[sourceid], &sourcestat) == 0) {
+          header->sourcesize[sourceid] = (long) sourcestat.st_size;
+          header->sourcemtime[sourceid] = (long) sourcestat.st_mtime;
+      }
+      else {
+          header->sourcesize[sourceid] = -1;
+          header->sourcemtime[sourceid] = -1;
+      }
+  }
+
+  return 0;
+
+}
+
+int mapreferencecache() {
+
+  /* returns 0 when the reference grids point into a valid cache, 1 when they still have to be read from netCDF */
+
+  referencecacheheader expectedheader, cacheheader;
+  struct stat cachestat;
+  int cachefd;
+
+  if (strcmp(referencecache, "none") == 0) {
+      return 1;
+  }
+
+  cachefd = open(referencecache, O_RDONLY);
+  if (cachefd < 0) {
+      printf("No Reference Cache: %s\n",referencecache);
+      return 1;
+  }
+
+  setreferencecacheheader(&expectedheader);
+  if (read(cachefd, &cacheheader, sizeof(referencecacheheader)) != sizeof(referencecacheheader) ||
+      memcmp(&cacheheader, &expectedheader, offsetof(referencecacheheader, datasize)) != 0 ||
+      fstat(cachefd, &cachestat) != 0 || cachestat.st_size < cacheheader.datasize) {
+      printf("Stale Reference Cache: %s\n",referencecache);
+      close(cachefd);
+      return 1;
+  }
+
+  printf("Mapping Reference Cache: %s\n",referencecache);
+  referencecachesize = cacheheader.datasize;
+  referencecachebase = (char *) mmap(NULL, referencecachesize, PROT_READ, MAP_SHARED, cachefd, 0);
+  close(cachefd);
+  if (referencecachebase == MAP_FAILED) {
+      referencecachebase = NULL;
+      printf("Unable to map Reference Cache: %s\n",referencecache);
+      return 1;
+  }
+
+  cachereferencefields();
+
+  inEDGEN = cacheheader.EDGEN;
+  inEDGEE = cacheheader.EDGEE;
+  inEDGES = cacheheader.EDGES;
+  inEDGEW = cacheheader.EDGEW;
+
+  return 0;
+
+}
+
+int writereferencecache() {
+
+  /* one time conversion after a netCDF read - written under a temporary name and renamed so concurrent jobs never map a partial file */
+
+  referencecacheheader cacheheader;
+  char tempcachename[1100];
+  int cachestat;
+
+  if (strcmp(referencecache, "none") == 0) {
+      return 0;
+  }
+
+  sprintf(tempcachename,"%s.%ld",referencecache,(long) getpid());
+  printf("Writing Reference Cache: %s\n",referencecache);
+  referencecachefile = fopen(tempcachename,"wb");
+  if (referencecachefile == NULL) {
+      printf("Unable to write Reference Cache: %s\n",tempcachename);
+      return 1;
+  }
+
+  cachereferencefields();
+
+  setreferencecacheheader(&cacheheader);
+  cacheheader.datasize = referencecacheoffset;
+  cacheheader.EDGEN = inEDGEN;
+  cacheheader.EDGEE = inEDGEE;
+  cacheheader.EDGES = inEDGES;
+  cacheheader.EDGEW = inEDGEW;
+  fseek(referencecachefile, 0, SEEK_SET);
+  fwrite(&cacheheader, 1, sizeof(referencecacheheader), referencecachefile);
+
+  cachestat = ferror(referencecachefile);
+  cachestat |= fclose(referencecachefile);
+  referencecachefile = NULL;
+  if (cachestat != 0 || rename(tempcachename, referencecache) != 0) {
+      printf("Unable to write Reference Cache: %s\n",tempcachename);
+      unlink(tempcachename);
+      return 1;
+  }
+
+  return 0;
+
+}
+
+int releasereferencegrids() {
+
+  /* drop one tile's reference grids before the next tile sizes its own - unmapped when they came from the cache, */
+  /* grids read from netCDF stay in the reference arena for the next tile to carve again */
+
+  if (referencecachebase != NULL) {
+      munmap(referencecachebase, referencecachesize);
+      referencecachebase = NULL;
+  }
+
+  return 0;
+
+}
+
+int createlandindex() {
+
+  /* sized once for the first tile, the largest, like the packed grids so every later tile's land fits */
+
+  long clmlin, clmpix;
+
+  landpixcount = 0;
+  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
+      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
+          if (inLANDMASKGrid[clmlin * MAXOUTPIX + clmpix] == 1.0) {
+              landpixindex[landpixcount] = clmlin * MAXOUTPIX + clmpix;
+              landpixcount++;
+          }
+      }
+  }
+
+  return 0;
+
+}
+
 int readLUHbasestateGrids() {
 
   int yearindex;
@@ -1812,7 +3274,25 @@ int readLUHbasestateGrids() {
 }
 
 
-int readLUHcurrstateGrids(int currentyear) {
+int readinputgrids(int producer, int yearindex, inputgridset *readset) {
+
+  /* every live grid one reader stage fills, in registry order, from the open input file */
+
+  inputgridentry *entry;
+  int entryid;
+
+  for (entryid = 0; entryid < INPUTGRIDS; entryid++) {
+      entry = &inputgridregistry[entryid];
+      if (entry->producer == producer && inputgridlive(entry)) {
+          readnc3dfield(entry->name,yearindex,*inputsetgrid(readset, entry->grid),flipLUHgrids);
+      }
+  }
+
+  return 0;
+
+}
+
+int readLUHcurrstateGrids(int currentyear, inputgridset *readset) {
 
   int yearindex;
   
@@ -1822,18 +3302,7 @@ int readLUHcurrstateGrids(int currentyear) {
   }
   openncinputfile(luhstatesdb); 
 
-  readnc3dfield("primf",yearindex,inCURRPRIMFGrid,flipLUHgrids);
-  readnc3dfield("primn",yearindex,inCURRPRIMNGrid,flipLUHgrids);
-  readnc3dfield("secdf",yearindex,inCURRSECDFGrid,flipLUHgrids);
-  readnc3dfield("secdn",yearindex,inCURRSECDNGrid,flipLUHgrids);
-  readnc3dfield("pastr",yearindex,inCURRPASTRGrid,flipLUHgrids);
-  readnc3dfield("range",yearindex,inCURRRANGEGrid,flipLUHgrids);
-  readnc3dfield("c3ann",yearindex,inCURRC3ANNGrid,flipLUHgrids);
-  readnc3dfield("c4ann",yearindex,inCURRC4ANNGrid,flipLUHgrids);
-  readnc3dfield("c3per",yearindex,inCURRC3PERGrid,flipLUHgrids);
-  readnc3dfield("c4per",yearindex,inCURRC4PERGrid,flipLUHgrids);
-  readnc3dfield("c3nfx",yearindex,inCURRC3NFXGrid,flipLUHgrids);
-  readnc3dfield("urban",yearindex,inCURRURBANGrid,flipLUHgrids);
+  readinputgrids(STAGE_CURRSTATES,yearindex,readset);
   
   closencfile();
 
@@ -1841,7 +3310,7 @@ int readLUHcurrstateGrids(int currentyear) {
   
 }
 
-int readLUHprevstateGrids(int prevyear) {
+int readLUHprevstateGrids(int prevyear, inputgridset *readset) {
 
   int yearindex;
   
@@ -1852,15 +3321,7 @@ int readLUHprevstateGrids(int prevyear) {
   
   openncinputfile(luhstatesdb); 
 
-  readnc3dfield("secdf",yearindex,inPREVSECDFGrid,flipLUHgrids);
-  readnc3dfield("secdn",yearindex,inPREVSECDNGrid,flipLUHgrids);
-  readnc3dfield("pastr",yearindex,inPREVPASTRGrid,flipLUHgrids);
-  readnc3dfield("range",yearindex,inPREVRANGEGrid,flipLUHgrids);
-  readnc3dfield("c3ann",yearindex,inPREVC3ANNGrid,flipLUHgrids);
-  readnc3dfield("c4ann",yearindex,inPREVC4ANNGrid,flipLUHgrids);
-  readnc3dfield("c3per",yearindex,inPREVC3PERGrid,flipLUHgrids);
-  readnc3dfield("c4per",yearindex,inPREVC4PERGrid,flipLUHgrids);
-  readnc3dfield("c3nfx",yearindex,inPREVC3NFXGrid,flipLUHgrids);
+  readinputgrids(STAGE_PREVSTATES,yearindex,readset);
   
   closencfile();
 
@@ -1868,8 +3329,32 @@ int readLUHprevstateGrids(int prevyear) {
   
 }
 
+int copyLUHprevstateGrids(inputgridset *readset, inputgridset *prevset) {
+
+  /* last year's current states are this year's previous states - copied from the previous set rather than read again */
+
+  inputgridentry *preventry, *currentry;
+  int preventryid, currentryid;
+
+  for (preventryid = 0; preventryid < INPUTGRIDS; preventryid++) {
+      preventry = &inputgridregistry[preventryid];
+      if (preventry->producer != STAGE_PREVSTATES || !inputgridlive(preventry)) {
+          continue;
+      }
+      for (currentryid = 0; currentryid < INPUTGRIDS; currentryid++) {
+          currentry = &inputgridregistry[currentryid];
+          if (currentry->producer == STAGE_CURRSTATES && strcmp(currentry->name, preventry->name) == 0) {
+              memcpy(*inputsetgrid(readset, preventry->grid), *inputsetgrid(prevset, currentry->grid), OUTDATASIZE);
+          }
+      }
+  }
+
+  return 0;
+
+}
+
 
-int readLUHwoodharvestGrids(int prevyear) {
+int readLUHwoodharvestGrids(int prevyear, inputgridset *readset) {
 
   int yearindex;
   
@@ -1880,16 +3365,7 @@ int readLUHwoodharvestGrids(int prevyear) {
   
   openncinputfile(luhtransitionsdb); 
   
-  readnc3dfield("primf_harv",yearindex,inHARVESTVH1Grid,flipLUHgrids);
-  readnc3dfield("primn_harv",yearindex,inHARVESTVH2Grid,flipLUHgrids);
-  readnc3dfield("secmf_harv",yearindex,inHARVESTSH1Grid,flipLUHgrids);
-  readnc3dfield("secyf_harv",yearindex,inHARVESTSH2Grid,flipLUHgrids);
-  readnc3dfield("secnf_harv",yearindex,inHARVESTSH3Grid,flipLUHgrids);
-  readnc3dfield("primf_bioh",yearindex,inBIOHVH1Grid,flipLUHgrids);
-  readnc3dfield("primn_bioh",yearindex,inBIOHVH2Grid,flipLUHgrids);
-  readnc3dfield("secmf_bioh",yearindex,inBIOHSH1Grid,flipLUHgrids);
-  readnc3dfield("secyf_bioh",yearindex,inBIOHSH2Grid,flipLUHgrids);
-  readnc3dfield("secnf_bioh",yearindex,inBIOHSH3Grid,flipLUHgrids);
+  readinputgrids(STAGE_WOODHARVEST,yearindex,readset);
   
   closencfile();
   
@@ -1898,1497 +3374,1605 @@ int readLUHwoodharvestGrids(int prevyear) {
 }
 
 
-int readUNREPSECDFGrids(int prevyear) {
+int readUNREPGrids(int prevyear, inputgridset *readset) {
+
+  /* the unrepresented loss of every source state in unreptransitions - each transition is read once and added */
+  /* straight into its source's UNREP grid in table order, then one pass turns the sums into losses - sources whose */
+  /* UNREP grid no stage reads have no grid and are skipped */
 
   int yearindex;
-  long clmlin, clmpix;
-  float totaltransloss;
+  int sourceid, destid;
+  long clmindex;
+  char fieldname[256];
+  float *unrepGrid[UNREPSOURCES];
+  float *prevGrid[UNREPSOURCES];
+  float *currGrid[UNREPSOURCES];
   float unreploss;
-  
+
   yearindex = prevyear - firstyear;
   if (yearindex < 0) {
       yearindex = 0;
   }
-  
-  openncinputfile(luhtransitionsdb); 
-  
-  readnc3dfield("secdf_to_secdn",yearindex,translossGrid,flipLUHgrids);
-  
-  readnc3dfield("secdf_to_urban",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
 
-  readnc3dfield("secdf_to_c3ann",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
-
-  readnc3dfield("secdf_to_c4ann",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
+  for (sourceid = 0; sourceid < UNREPSOURCES; sourceid++) {
+      unrepGrid[sourceid] = *inputsetgrid(readset, unreptransitions[sourceid].unrepgrid);
+      prevGrid[sourceid] = *inputsetgrid(readset, unreptransitions[sourceid].prevgrid);
+      currGrid[sourceid] = *inputsetgrid(readset, unreptransitions[sourceid].currgrid);
   }
 
-  readnc3dfield("secdf_to_c3per",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+  openncinputfile(luhtransitionsdb);
 
-  readnc3dfield("secdf_to_c4per",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
+  for (sourceid = 0; sourceid < UNREPSOURCES; sourceid++) {
+      if (unrepGrid[sourceid] == NULL) {
+          continue;
       }
-  }
-
-  readnc3dfield("secdf_to_c3nfx",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
+      sprintf(fieldname,"%s_to_%s",unreptransitions[sourceid].source,unreptransitions[sourceid].destinations[0]);
+      readnc3dfield(fieldname,yearindex,unrepGrid[sourceid],flipLUHgrids);
+      for (destid = 1; destid < UNREPDESTINATIONS; destid++) {
+          sprintf(fieldname,"%s_to_%s",unreptransitions[sourceid].source,unreptransitions[sourceid].destinations[destid]);
+          readnc3dfield(fieldname,yearindex,tempGrid,flipLUHgrids);
+          for (clmindex = 0; clmindex < MAXOUTPIX * MAXOUTLIN; clmindex++) {
+              unrepGrid[sourceid][clmindex] = unrepGrid[sourceid][clmindex] + tempGrid[clmindex];
+          }
       }
   }
 
-  readnc3dfield("secdf_to_pastr",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+  closencfile();
 
-  readnc3dfield("secdf_to_range",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          totaltransloss = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-          unreploss = totaltransloss - (inPREVSECDFGrid[clmlin * MAXOUTPIX + clmpix] - inCURRSECDFGrid[clmlin * MAXOUTPIX + clmpix]);
+  for (clmindex = 0; clmindex < MAXOUTPIX * MAXOUTLIN; clmindex++) {
+      for (sourceid = 0; sourceid < UNREPSOURCES; sourceid++) {
+          if (unrepGrid[sourceid] == NULL) {
+              continue;
+          }
+          unreploss = unrepGrid[sourceid][clmindex] - (prevGrid[sourceid][clmindex] - currGrid[sourceid][clmindex]);
           if (unreploss < 0.0) {
               unreploss = 0.0;
           }
-          inUNREPSECDFGrid[clmlin * MAXOUTPIX + clmpix] = unreploss;
+          unrepGrid[sourceid][clmindex] = unreploss;
       }
   }
-  
-  closencfile();
 
   return 0;
-  
+
 }
 
 
-int readUNREPSECDNGrids(int prevyear) {
+int readLUHcropmanagementGrids(int curryear, inputgridset *readset) {
 
   int yearindex;
-  long clmlin, clmpix;
-  float totaltransloss;
-  float unreploss;
   
-  yearindex = prevyear - firstyear;
+  yearindex = curryear - firstyear;
   if (yearindex < 0) {
       yearindex = 0;
   }
   
-  openncinputfile(luhtransitionsdb); 
+  openncinputfile(luhmanagementdb); 
   
-  readnc3dfield("secdn_to_secdf",yearindex,translossGrid,flipLUHgrids);
+  readinputgrids(STAGE_MANAGEMENT,yearindex,readset);
 
-  readnc3dfield("secdn_to_urban",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+  closencfile();
+  
+  return 0;
+  
+}
 
-  readnc3dfield("secdn_to_c3ann",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+int readLUHyearGrids(int yearnumber, inputgridset *readset, inputgridset *prevset) {
 
-  readnc3dfield("secdn_to_c4ann",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+  /* all per year LUH reads into one input set - holds ncaccessmutex so the reads never overlap a write on the writer thread */
 
-  readnc3dfield("secdn_to_c3per",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+  phaseclock clock;
 
-  readnc3dfield("secdn_to_c4per",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+  selectinputgridset(readset);
 
-  readnc3dfield("secdn_to_c3nfx",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
+  pthread_mutex_lock(&ncaccessmutex);
+
+  startphase(&clock);
+  if ((enabledstages & STAGE_PREVSTATES) != 0) {
+      if (yearnumber == startyear) {
+          readLUHprevstateGrids(yearnumber-1,readset);
+      }
+      else {
+          copyLUHprevstateGrids(readset,prevset);
       }
   }
+  readLUHcurrstateGrids(yearnumber,readset);
+  endphase(&clock,PHASE_STATES,yearnumber,MAXOUTPIX * MAXOUTLIN,1);
+  
+  startphase(&clock);
+  readLUHwoodharvestGrids(yearnumber-1,readset);
+  endphase(&clock,PHASE_WOODHARVEST,yearnumber,MAXOUTPIX * MAXOUTLIN,1);
+  
+  if ((enabledstages & STAGE_UNREP) != 0) {
+      startphase(&clock);
+      readUNREPGrids(yearnumber-1,readset);
+      endphase(&clock,PHASE_TRANSITIONS,yearnumber,MAXOUTPIX * MAXOUTLIN,1);
+  }
 
-  readnc3dfield("secdn_to_pastr",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
+  startphase(&clock);
+  readLUHcropmanagementGrids(yearnumber,readset);
+  endphase(&clock,PHASE_MANAGEMENT,yearnumber,MAXOUTPIX * MAXOUTLIN,1);
+
+  pthread_mutex_unlock(&ncaccessmutex);
+
+  return 0;
+
+}
+
+int generateLUHstaterun(float *__restrict primf, float *__restrict primn, float *__restrict secdf, float *__restrict secdn,
+                        float *__restrict pastr, float *__restrict range, float *__restrict c3ann, float *__restrict c4ann,
+                        float *__restrict c3per, float *__restrict c4per, float *__restrict c3nfx,
+                        float *__restrict foresttotal, float *__restrict nonforesttotal, float *__restrict croptotal,
+                        float *__restrict missing, float *__restrict other, float *__restrict natveg, long runlength) {
+
+  /* the collection grids of one LUH state over a run of land pixels that are neighbours in the region grid - the */
+  /* inputs start at the run's region index and the outputs at its land index so every access is contiguous, and */
+  /* the clamps are selects so the loop vectorizes - values are formed in the same order and precision as the */
+  /* scalar code so the results are bitwise the same as long as the compiler keeps that order, which strict IEEE */
+  /* builds do (icc needs -fp-model precise, and -ffast-math breaks it) */
+
+  long runpix;
+  float foresttotalval, nonforesttotalval, croptotalval, missingval, otherval;
+
+  for (runpix = 0; runpix < runlength; runpix++) {
+      foresttotalval = primf[runpix] + secdf[runpix];
+      nonforesttotalval = primn[runpix] + secdn[runpix];
+      croptotalval = c3ann[runpix] + c4ann[runpix] + c3per[runpix] + c4per[runpix] + c3nfx[runpix];
+      missingval = 1.0 - foresttotalval - nonforesttotalval - pastr[runpix] - range[runpix] - croptotalval;
+      missingval = missingval < 0.0 ? 0.0 : missingval;
+      missingval = missingval > 1.0 ? 1.0 : missingval;
+      otherval = primn[runpix] + secdn[runpix] + range[runpix] + missingval;
+      foresttotal[runpix] = foresttotalval;
+      nonforesttotal[runpix] = nonforesttotalval;
+      croptotal[runpix] = croptotalval;
+      missing[runpix] = missingval;
+      other[runpix] = otherval;
+      natveg[runpix] = foresttotalval + pastr[runpix] + otherval;
   }
 
-  readnc3dfield("secdn_to_range",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          totaltransloss = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-          unreploss = totaltransloss - (inPREVSECDNGrid[clmlin * MAXOUTPIX + clmpix] - inCURRSECDNGrid[clmlin * MAXOUTPIX + clmpix]);
-          if (unreploss < 0.0) {
-              unreploss = 0.0;
-          }
-          inUNREPSECDNGrid[clmlin * MAXOUTPIX + clmpix] = unreploss;
-      }
+  return 0;
+
+}
+
+int generateLUHunrepresentedrun(float *__restrict unrepsecdf, float *__restrict unrepsecdn, float *__restrict harvestsh1,
+                                float *__restrict harvestsh2, float *__restrict harvestsh3,
+                                float *__restrict unrepforest, float *__restrict unrepother, long runlength) {
+
+  long runpix;
+  float unrepforestval, unrepotherval;
+
+  for (runpix = 0; runpix < runlength; runpix++) {
+      unrepforestval = unrepsecdf[runpix] - harvestsh1[runpix] - harvestsh2[runpix];
+      unrepforestval = unrepforestval < 0.0 ? 0.0 : unrepforestval;
+      unrepforestval = unrepforestval > 1.0 ? 1.0 : unrepforestval;
+      unrepforest[runpix] = unrepforestval;
+      unrepotherval = unrepsecdn[runpix] - harvestsh3[runpix];
+      unrepotherval = unrepotherval < 0.0 ? 0.0 : unrepotherval;
+      unrepotherval = unrepotherval > 1.0 ? 1.0 : unrepotherval;
+      unrepother[runpix] = unrepotherval;
   }
 
-  closencfile();
-  
   return 0;
-  
+
 }
 
+int generateLUHcollectionGrids(long landstart, long landend) {
 
-int readUNREPC3ANNGrids(int prevyear) {
+  /* the land index in runs of pixels that are also neighbours in the region grid - a run ends at a row end or ocean */
 
-  int yearindex;
-  long clmlin, clmpix;
-  float totaltransloss;
-  float unreploss;
+  long landid, clmindex, runlength;
   
-  yearindex = prevyear - firstyear;
-  if (yearindex < 0) {
-      yearindex = 0;
-  }
-  
-  openncinputfile(luhtransitionsdb); 
-  
-  readnc3dfield("c3ann_to_secdn",yearindex,translossGrid,flipLUHgrids);
-  
-  readnc3dfield("c3ann_to_urban",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
+  for (landid = landstart; landid < landend; landid += runlength) {
+      clmindex = landpixindex[landid];
+      runlength = 1;
+      while (landid + runlength < landend && landpixindex[landid + runlength] == clmindex + runlength) {
+          runlength++;
       }
-  }
 
-  readnc3dfield("c3ann_to_secdf",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
+      generateLUHstaterun(inBASEPRIMFGrid + clmindex, inBASEPRIMNGrid + clmindex, inBASESECDFGrid + clmindex, inBASESECDNGrid + clmindex,
+                          inBASEPASTRGrid + clmindex, inBASERANGEGrid + clmindex, inBASEC3ANNGrid + clmindex, inBASEC4ANNGrid + clmindex,
+                          inBASEC3PERGrid + clmindex, inBASEC4PERGrid + clmindex, inBASEC3NFXGrid + clmindex,
+                          inBASEFORESTTOTALGrid + (landid - landstart), inBASENONFORESTTOTALGrid + (landid - landstart), inBASECROPTOTALGrid + (landid - landstart),
+                          inBASEMISSINGGrid + (landid - landstart), inBASEOTHERGrid + (landid - landstart), inBASENATVEGGrid + (landid - landstart), runlength);
+
+      generateLUHstaterun(inCURRPRIMFGrid + clmindex, inCURRPRIMNGrid + clmindex, inCURRSECDFGrid + clmindex, inCURRSECDNGrid + clmindex,
+                          inCURRPASTRGrid + clmindex, inCURRRANGEGrid + clmindex, inCURRC3ANNGrid + clmindex, inCURRC4ANNGrid + clmindex,
+                          inCURRC3PERGrid + clmindex, inCURRC4PERGrid + clmindex, inCURRC3NFXGrid + clmindex,
+                          inCURRFORESTTOTALGrid + (landid - landstart), inCURRNONFORESTTOTALGrid + (landid - landstart), inCURRCROPTOTALGrid + (landid - landstart),
+                          inCURRMISSINGGrid + (landid - landstart), inCURROTHERGrid + (landid - landstart), inCURRNATVEGGrid + (landid - landstart), runlength);
+
+      generateLUHunrepresentedrun(inUNREPSECDFGrid + clmindex, inUNREPSECDNGrid + clmindex, inHARVESTSH1Grid + clmindex,
+                                  inHARVESTSH2Grid + clmindex, inHARVESTSH3Grid + clmindex,
+                                  inUNREPFORESTGrid + (landid - landstart), inUNREPOTHERGrid + (landid - landstart), runlength);
   }
+            
+  return 0;
+  
+}
 
-  readnc3dfield("c3ann_to_c4ann",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
 
-  readnc3dfield("c3ann_to_c3per",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+int generateclmPFTGrids(long landstart, long landend) {
 
-  readnc3dfield("c3ann_to_c4per",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
+  long landid, clmindex, blockpix;
+  int pftid;
+  float pctnatvegval, pctnatvegbase, forestunrepval, pastureunrepval, otherunrepval;
+  float foresttotalbaseval, foresttotalfracval, foresttotalfracdelta, foresttotalcurrentval;
+  float pasturebaseval, pasturefracval, pasturecurrentval, pasturefracdelta;
+  float otherbaseval, otherfracval, othercurrentval, otherfracdelta;
+  float currentpctforestpft, deltapctforestpft;
+  float currentpctpasturepft, deltapctpasturepft;
+  float currentpctotherpft, deltapctotherpft;
+  float unrepforestfrac, unrepotherfrac;
+  float newpctpft, unreppctpft, newpctpfttotal;
+  float *currentpft, *forestpft, *pasturepft, *otherpft, *pctpft, *unreppft;
+  long inpftstep, outpftstep;
+
+  /* every PFT of a pixel through one pointer per block - contiguous short vectors when the blocks are pixel major */
+
+  inpftstep = blocktypestep(inCURRENTPCTPFTGrid);
+  outpftstep = blocktypestep(outPCTPFTGrid);
+  
+  for (landid = landstart; landid < landend; landid++) {
+      clmindex = landpixindex[landid];
+      blockpix = landid - landstart;
+      currentpft = inCURRENTPCTPFTGrid[0] + clmindex * PFTPIXSTEP;
+      forestpft = inFORESTPCTPFTGrid[0] + clmindex * PFTPIXSTEP;
+      pasturepft = inPASTUREPCTPFTGrid[0] + clmindex * PFTPIXSTEP;
+      otherpft = inOTHERPCTPFTGrid[0] + clmindex * PFTPIXSTEP;
+      pctpft = outPCTPFTGrid[0] + landid * PFTPIXSTEP;
+      unreppft = outUNREPPFTGrid[0] + landid * PFTPIXSTEP;
+      pctnatvegval = inCURRNATVEGGrid[blockpix] * 100.0;
+      if (pctnatvegval > 0.0) {
+          outPCTNATVEGGrid[landid] = pctnatvegval;
+          pctnatvegbase = inBASENATVEGGrid[blockpix] * 100.0;
+          forestunrepval = inUNREPFORESTGrid[blockpix];
+          otherunrepval = inUNREPOTHERGrid[blockpix];
+          if (pctnatvegbase > 0.0) {
+              foresttotalbaseval = inBASEFORESTTOTALGrid[blockpix] / pctnatvegbase * 100.0;
+              foresttotalfracval = inCURRFORESTTOTALGrid[blockpix] / pctnatvegval * 100.0;
+              foresttotalfracdelta = foresttotalfracval - foresttotalbaseval;
+              if (foresttotalfracdelta >= 0.0) {
+                  foresttotalcurrentval = foresttotalbaseval;
+              }
+              else {
+                  foresttotalcurrentval = foresttotalbaseval + foresttotalfracdelta;
+                  foresttotalfracdelta = 0.0;
+              }
+              pasturebaseval = inBASEPASTRGrid[clmindex] / pctnatvegbase * 100.0;
+              pasturefracval = inCURRPASTRGrid[clmindex] / pctnatvegval * 100.0;
+              pasturecurrentval = 0.0;
+              pasturefracdelta = pasturefracval;
+              otherbaseval = inBASEOTHERGrid[blockpix] / pctnatvegbase * 100.0;
+              otherfracval = inCURROTHERGrid[blockpix] / pctnatvegval * 100.0;
+              otherfracdelta = otherfracval - otherbaseval;
+              if (otherfracdelta >= 0.0) {
+                  othercurrentval = otherbaseval;
+              }
+              else {
+                  othercurrentval = otherbaseval + otherfracdelta;
+                  otherfracdelta = 0.0;
+              }
+          }
+          else {
+              foresttotalcurrentval = 0.0;
+              foresttotalfracdelta = inCURRFORESTTOTALGrid[blockpix] / pctnatvegval * 100.0;
+              pasturecurrentval = 0.0;
+              pasturefracdelta = inCURRPASTRGrid[clmindex] / pctnatvegval * 100.0;
+              othercurrentval = 0.0;
+              otherfracdelta = inCURROTHERGrid[blockpix] / pctnatvegval * 100.0;
+          }
+          for (pftid = 0; pftid < MAXPFT; pftid++) {
+              currentpctforestpft = foresttotalcurrentval * currentpft[pftid * inpftstep];
+              deltapctforestpft = foresttotalfracdelta * forestpft[pftid * inpftstep];
+              unrepforestfrac = forestunrepval * (currentpctforestpft + deltapctforestpft) / 100.0;
+              currentpctpasturepft = pasturecurrentval * currentpft[pftid * inpftstep];
+              deltapctpasturepft = pasturefracdelta * pasturepft[pftid * inpftstep];
+              currentpctotherpft = othercurrentval * currentpft[pftid * inpftstep];
+              deltapctotherpft = otherfracdelta * otherpft[pftid * inpftstep];
+              newpctpft = currentpctforestpft + deltapctforestpft + currentpctpasturepft + deltapctpasturepft + currentpctotherpft + deltapctotherpft;
+              pctpft[pftid * outpftstep] = newpctpft;
+              unreppft[pftid * outpftstep] = unrepforestfrac;
+          }
+          newpctpfttotal = 0.0;
+          for (pftid = 0; pftid < MAXPFT; pftid++) {
+              newpctpfttotal = newpctpfttotal + pctpft[pftid * outpftstep];
+          }
+          if (newpctpfttotal > 0.0) {
+              for (pftid = 0; pftid < MAXPFT; pftid++) {
+                  newpctpft = pctpft[pftid * outpftstep];
+                  if (newpctpft > 0.0) {
+                      newpctpft = newpctpft / newpctpfttotal * 100.0;
+                      unreppctpft = unreppctpft / newpctpfttotal * 100.0;
+                      if (unreppctpft > newpctpft) {
+                          unreppctpft = newpctpft;
+                      }
+                      pctpft[pftid * outpftstep] = newpctpft;
+                  }
+                  else {
+                      pctpft[pftid * outpftstep] = 0.0;
+                  }
+              }
+          }
       }
-  }
-
-  readnc3dfield("c3ann_to_c3nfx",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
+      else {
+          outPCTNATVEGGrid[landid] = 0.0;
+          pctpft[0] = 100.0;
+          unreppft[0] = 0.0;
+          for (pftid = 0; pftid < MAXPFT; pftid++) {
+              pctpft[pftid * outpftstep] = 0.0;
+              unreppft[pftid * outpftstep] = 0.0;
+          }
       }
   }
 
-  readnc3dfield("c3ann_to_pastr",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
+  return 0;
+  
+}
+
+
+int generateclmCFTGrids(long landstart, long landend) {
+
+  long landid, clmindex, blockpix;
+  int cftid, rawcftid, rainfedcftid, irrigcftid;
+  float pctcropval, c3annunrepval, c4annunrepval, c3perunrepval, c4perunrepval, c3nfxunrepval;
+  float newpctrainfedcft, newpctirrigcft, newunreprainfedval, newunrepirrigval;
+  float newpctcroptotal, newpctcft;
+  float *c3anncft, *c4anncft, *c3percft, *c4percft, *c3nfxcft, *pctcft, *unrepcft, *fertcft;
+  long incftstep, outcftstep;
+
+  /* every CFT of a pixel through one pointer per block - contiguous short vectors when the blocks are pixel major */
+
+  incftstep = blocktypestep(inC3ANNPCTCFTGrid);
+  outcftstep = blocktypestep(outPCTCFTGrid);
+
+  for (landid = landstart; landid < landend; landid++) {
+      clmindex = landpixindex[landid];
+      blockpix = landid - landstart;
+      c3anncft = inC3ANNPCTCFTGrid[0] + clmindex * CFTRAWPIXSTEP;
+      c4anncft = inC4ANNPCTCFTGrid[0] + clmindex * CFTRAWPIXSTEP;
+      c3percft = inC3PERPCTCFTGrid[0] + clmindex * CFTRAWPIXSTEP;
+      c4percft = inC4PERPCTCFTGrid[0] + clmindex * CFTRAWPIXSTEP;
+      c3nfxcft = inC3NFXPCTCFTGrid[0] + clmindex * CFTRAWPIXSTEP;
+      pctcft = outPCTCFTGrid[0] + landid * CFTPIXSTEP;
+      unrepcft = outUNREPCFTGrid[0] + landid * CFTPIXSTEP;
+      fertcft = outFERTNITROGrid[0] + landid * CFTPIXSTEP;
+      pctcropval = inCURRCROPTOTALGrid[blockpix] * 100.0;
+      if (pctcropval > 0.0 && pctcropval <= 100.0) {
+          outPCTCROPGrid[landid] = pctcropval;
+          c3annunrepval = inUNREPC3ANNGrid[clmindex];
+          c4annunrepval = inUNREPC4ANNGrid[clmindex];
+          c3perunrepval = inUNREPC3PERGrid[clmindex];
+          c4perunrepval = inUNREPC4PERGrid[clmindex];
+          c3nfxunrepval = inUNREPC3NFXGrid[clmindex];
+          for (rawcftid = 0; rawcftid < MAXCFTRAW; rawcftid++) {
+              rainfedcftid = 2 * (rawcftid + 1);
+              irrigcftid = 2 * (rawcftid + 1) + 1;
+              newpctrainfedcft = inCURRC3ANNGrid[clmindex] * (1.0 - inIRRIGC3ANNGrid[clmindex]) * c3anncft[rawcftid * incftstep];
+              newpctirrigcft = inCURRC3ANNGrid[clmindex] * (inIRRIGC3ANNGrid[clmindex]) * c3anncft[rawcftid * incftstep];
+              newunreprainfedval = c3annunrepval * newpctrainfedcft / 100.0;
+              newunrepirrigval = c3annunrepval * newpctirrigcft / 100.0;
+              if (newpctrainfedcft > 0.0) {
+                  pctcft[rainfedcftid * outcftstep] = pctcft[rainfedcftid * outcftstep] + newpctrainfedcft;
+                  unrepcft[rainfedcftid * outcftstep] = unrepcft[rainfedcftid * outcftstep] + newunreprainfedval;
+                  fertcft[rainfedcftid * outcftstep] = inFERTC3ANNGrid[clmindex] / 10.0;
+              }
+              if (newpctirrigcft > 0.0) {
+                  pctcft[irrigcftid * outcftstep] = pctcft[irrigcftid * outcftstep] + newpctirrigcft;
+                  unrepcft[irrigcftid * outcftstep] = unrepcft[irrigcftid * outcftstep] + newunrepirrigval;
+                  fertcft[irrigcftid * outcftstep] = inFERTC3ANNGrid[clmindex] / 10.0;
+              }
+              newpctrainfedcft = inCURRC4ANNGrid[clmindex] * (1.0 - inIRRIGC4ANNGrid[clmindex]) * c4anncft[rawcftid * incftstep];
+              newpctirrigcft = inCURRC4ANNGrid[clmindex] * (inIRRIGC4ANNGrid[clmindex]) * c4anncft[rawcftid * incftstep];
+              newunreprainfedval = c4annunrepval * newpctrainfedcft / 100.0;
+              newunrepirrigval = c4annunrepval * newpctirrigcft / 100.0;
+              if (newpctrainfedcft > 0.0) {
+                  pctcft[rainfedcftid * outcftstep] = pctcft[rainfedcftid * outcftstep] + newpctrainfedcft;
+                  unrepcft[rainfedcftid * outcftstep] = unrepcft[rainfedcftid * outcftstep] + newunreprainfedval;
+                  fertcft[rainfedcftid * outcftstep] = inFERTC4ANNGrid[clmindex] / 10.0;
+              }
+              if (newpctirrigcft > 0.0) {
+                  pctcft[irrigcftid * outcftstep] = pctcft[irrigcftid * outcftstep] + newpctirrigcft;
+                  unrepcft[rainfedcftid * outcftstep] = unrepcft[rainfedcftid * outcftstep] + newunrepirrigval;
+                  fertcft[irrigcftid * outcftstep] = inFERTC4ANNGrid[clmindex] / 10.0;
+              }
+              newpctrainfedcft = inCURRC3PERGrid[clmindex] * (1.0 - inIRRIGC3PERGrid[clmindex]) * c3percft[rawcftid * incftstep];
+              newpctirrigcft = inCURRC3PERGrid[clmindex] * (inIRRIGC3PERGrid[clmindex]) * c3percft[rawcftid * incftstep];
+              newunreprainfedval = c3perunrepval * newpctrainfedcft / 100.0;
+              newunrepirrigval = c3perunrepval * newpctirrigcft / 100.0;
+              if (newpctrainfedcft > 0.0) {
+                  pctcft[rainfedcftid * outcftstep] = pctcft[rainfedcftid * outcftstep] + newpctrainfedcft;
+                  unrepcft[rainfedcftid * outcftstep] = unrepcft[rainfedcftid * outcftstep] + newunreprainfedval;
+                  fertcft[rainfedcftid * outcftstep] = inFERTC3PERGrid[clmindex] / 10.0;
+              }
+              if (newpctirrigcft > 0.0) {
+                  pctcft[irrigcftid * outcftstep] = pctcft[irrigcftid * outcftstep] + newpctirrigcft;
+                  unrepcft[rainfedcftid * outcftstep] = unrepcft[rainfedcftid * outcftstep] + newunrepirrigval;
+                  fertcft[irrigcftid * outcftstep] = inFERTC3PERGrid[clmindex] / 10.0;
+              }
+              newpctrainfedcft = inCURRC4PERGrid[clmindex] * (1.0 - inIRRIGC4PERGrid[clmindex]) * c4percft[rawcftid * incftstep];
+              newpctirrigcft = inCURRC4PERGrid[clmindex] * (inIRRIGC4PERGrid[clmindex]) * c4percft[rawcftid * incftstep];
+              newunreprainfedval = c4perunrepval * newpctrainfedcft / 100.0;
+              newunrepirrigval = c4perunrepval * newpctirrigcft / 100.0;
+              if (newpctrainfedcft > 0.0) {
+                  pctcft[rainfedcftid * outcftstep] = pctcft[rainfedcftid * outcftstep] + newpctrainfedcft;
+                  unrepcft[rainfedcftid * outcftstep] = unrepcft[rainfedcftid * outcftstep] + newunreprainfedval;
+                  fertcft[rainfedcftid * outcftstep] = inFERTC4PERGrid[clmindex] / 10.0;
+              }
+              if (newpctirrigcft > 0.0) {
+                  pctcft[irrigcftid * outcftstep] = pctcft[irrigcftid * outcftstep] + newpctirrigcft;
+                  unrepcft[rainfedcftid * outcftstep] = unrepcft[rainfedcftid * outcftstep] + newunrepirrigval;
+                  fertcft[irrigcftid * outcftstep] = inFERTC4PERGrid[clmindex] / 10.0;
+              }
+              newpctrainfedcft = inCURRC3NFXGrid[clmindex] * (1.0 - inIRRIGC3NFXGrid[clmindex]) * c3nfxcft[rawcftid * incftstep];
+              newpctirrigcft = inCURRC3NFXGrid[clmindex] * (inIRRIGC3NFXGrid[clmindex]) * c3nfxcft[rawcftid * incftstep];
+              newunreprainfedval = c3nfxunrepval * newpctrainfedcft / 100.0;
+              newunrepirrigval = c3nfxunrepval * newpctirrigcft / 100.0;
+              if (newpctrainfedcft > 0.0) {
+                  pctcft[rainfedcftid * outcftstep] = pctcft[rainfedcftid * outcftstep] + newpctrainfedcft;
+                  unrepcft[rainfedcftid * outcftstep] = unrepcft[rainfedcftid * outcftstep] + newunreprainfedval;
+                  fertcft[rainfedcftid * outcftstep] = inFERTC3NFXGrid[clmindex] / 10.0;
+              }
+              if (newpctirrigcft > 0.0) {
+                  pctcft[irrigcftid * outcftstep] = pctcft[irrigcftid * outcftstep] + newpctirrigcft;
+                  unrepcft[rainfedcftid * outcftstep] = unrepcft[rainfedcftid * outcftstep] + newunrepirrigval;
+                  fertcft[irrigcftid * outcftstep] = inFERTC3NFXGrid[clmindex] / 10.0;
+              }
+          }
+          newpctcroptotal = 0.0;
+          for (cftid = 0; cftid < MAXCFT; cftid++) {
+              newpctcroptotal = newpctcroptotal + pctcft[cftid * outcftstep];
+          }
+          if (newpctcroptotal > 0.0) {
+              for (cftid = 0; cftid < MAXCFT; cftid++) {
+                  newpctcft = pctcft[cftid * outcftstep];
+                  if (newpctcft > 0.0) {
+                      newpctcft = newpctcft / newpctcroptotal * 100.0;
+                      pctcft[cftid * outcftstep] = newpctcft;
+                  }
+                  else {
+                      pctcft[cftid * outcftstep] = 0.0;
+                  }
+              }
+          }
+      }
+      else {
+          outPCTCROPGrid[landid] = 0.0;
+          pctcft[0] = 100.0;
+          unrepcft[0] = 0.0;
+          for (cftid = 1; cftid < MAXCFT; cftid++) {
+              pctcft[cftid * outcftstep] = 0.0;
+              unrepcft[cftid * outcftstep] = 0.0;
+          }
       }
   }
 
-  readnc3dfield("c3ann_to_range",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          totaltransloss = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-          unreploss = totaltransloss - (inPREVC3ANNGrid[clmlin * MAXOUTPIX + clmpix] - inCURRC3ANNGrid[clmlin * MAXOUTPIX + clmpix]);
-          if (unreploss < 0.0) {
-              unreploss = 0.0;
+  return 0;
+  
+}
+
+
+int generateclmwoodharvestGrids(long landstart, long landend) {
+
+  long landid, clmindex, blockpix;
+  int pftid;
+  float TreePFTArea, TreeFrac, TreeScale, PFTArea;
+  float newharvestvh1, newharvestvh2, newharvestsh1, newharvestsh2, newharvestsh3;
+  float newbiohvh1, newbiohvh2, newbiohsh1, newbiohsh2, newbiohsh3;
+
+  for (landid = landstart; landid < landend; landid++) {
+      clmindex = landpixindex[landid];
+      blockpix = landid - landstart;
+      TreePFTArea = 0.0;
+      TreeFrac = 0.0;
+      PFTArea = inAREAGrid[clmindex] * inLANDFRACGrid[clmindex] * outPCTNATVEGGrid[landid] / 100.0 * 1.0e6;              
+      for (pftid = firsttreepft; pftid <= lasttreepft; pftid++) {
+          TreePFTArea = TreePFTArea + PFTArea * outPCTPFTGrid[pftid][landid * PFTPIXSTEP] / 100.0;
+          TreeFrac = TreeFrac + outPCTPFTGrid[pftid][landid * PFTPIXSTEP] / 100.0;
+      }
+      TreeScale = 1.0;
+      if (TreePFTArea > 1.0e6) {
+           newharvestvh1 = inHARVESTVH1Grid[clmindex] * TreeScale;
+          if (newharvestvh1 < 0.0 || newharvestvh1 > 9.0e4) {
+              newharvestvh1 = 0.0;
+          }
+          if (newharvestvh1 > 0.98) {
+              newharvestvh1 = 0.98;
+          }
+          outHARVESTVH1Grid[blockpix] = newharvestvh1;
+           newbiohvh1 = inBIOHVH1Grid[clmindex] * 1000.0 / TreePFTArea * TreeScale;
+          if (newbiohvh1 < 0.0) {
+              newbiohvh1 = 0.0;
+          }
+          if (newbiohvh1 > 10000.0) {
+              newbiohvh1 = 10000.0;
+          }
+          outBIOHVH1Grid[landid] = newbiohvh1;
+           newharvestvh2 = inHARVESTVH2Grid[clmindex] * TreeScale;
+          if (newharvestvh2 < 0.0 || newharvestvh2 > 9.0e4) {
+              newharvestvh2 = 0.0;
           }
-          inUNREPC3ANNGrid[clmlin * MAXOUTPIX + clmpix] = unreploss;
+          if (newharvestvh2 > 0.98) {
+              newharvestvh2 = 0.98;
+          }
+          outHARVESTVH2Grid[blockpix] = newharvestvh2;
+          newbiohvh2 = inBIOHVH2Grid[clmindex] * 1000.0 / TreePFTArea * TreeScale;
+          if (newbiohvh2 < 0.0) {
+              newbiohvh2 = 0.0;
+          }
+          if (newbiohvh2 > 10000.0) {
+              newbiohvh2 = 10000.0;
+          }
+          outBIOHVH2Grid[landid] = newbiohvh2;
+           newharvestsh1 = inHARVESTSH1Grid[clmindex] * TreeScale;
+          if (newharvestsh1 < 0.0 || newharvestsh1 > 9.0e4) {
+              newharvestsh1 = 0.0;
+          }
+          if (newharvestsh1 > 0.98) {
+              newharvestsh1 = 0.98;
+          }
+          outHARVESTSH1Grid[blockpix] = newharvestsh1;
+          newbiohsh1 = inBIOHSH1Grid[clmindex] * 1000.0 / TreePFTArea * TreeScale;
+          if (newbiohsh1 < 0.0) {
+              newbiohsh1 = 0.0;
+          }
+          if (newbiohsh1 > 10000.0) {
+              newbiohsh1 = 10000.0;
+          }
+          outBIOHSH1Grid[landid] = newbiohsh1;
+           newharvestsh2 = inHARVESTSH2Grid[clmindex] * TreeScale;
+          if (newharvestsh2 < 0.0 || newharvestsh2 > 9.0e4) {
+              newharvestsh2 = 0.0;
+          }
+          if (newharvestsh2 > 0.98) {
+              newharvestsh2 = 0.98;
+          }
+          outHARVESTSH2Grid[blockpix] = newharvestsh2;
+          newbiohsh2 = inBIOHSH2Grid[clmindex] * 1000.0 / TreePFTArea * TreeScale;
+          if (newbiohsh2 < 0.0) {
+              newbiohsh2 = 0.0;
+          }
+          if (newbiohsh2 > 10000.0) {
+              newbiohsh2 = 10000.0;
+          }
+          outBIOHSH2Grid[landid] = newbiohsh2;
+           newharvestsh3 = inHARVESTSH3Grid[clmindex] * TreeScale;
+          if (newharvestsh3 < 0.0 || newharvestsh3 > 9.0e4) {
+              newharvestsh3 = 0.0;
+          }
+          if (newharvestsh3 > 0.98) {
+              newharvestsh3 = 0.98;
+          }
+          outHARVESTSH3Grid[blockpix] = newharvestsh3;
+          newbiohsh3 = inBIOHSH3Grid[clmindex] * 1000.0 / TreePFTArea * TreeScale;
+          if (newbiohsh3 < 0.0) {
+              newbiohsh3 = 0.0;
+          }
+          if (newbiohsh3 > 10000.0) {
+              newbiohsh3 = 10000.0;
+          }
+          outBIOHSH3Grid[landid] = newbiohsh3;
       }
   }
 
-  closencfile();
-  
   return 0;
   
 }
 
+int generatedblsums(outputgridset *writeset) {
 
-int readUNREPC4ANNGrids(int prevyear) {
+  /* the per land pixel sums the year's double slices are normalized by - the only grids the writer keeps in double */
 
-  int yearindex;
-  long clmlin, clmpix;
-  float totaltransloss;
-  float unreploss;
+  long landid, pftstep, cftstep;
+  int pftid, cftid;
+  double AllPFTs, AllCFTs;
+  float *pctpft, *pctcft;
+  
+  pftstep = blocktypestep(writeset->PCTPFTGrid);
+  cftstep = blocktypestep(writeset->PCTCFTGrid);
+
+  for (landid = 0; landid < landpixcount; landid++) {
+      outAllFracdblGrid[landid] = (double) writeset->PCTCROPGrid[landid] + (double) writeset->PCTNATVEGGrid[landid];
+      pctpft = writeset->PCTPFTGrid[0] + landid * PFTPIXSTEP;
+      AllPFTs = 0.0;
+      for (pftid = 0; pftid < MAXPFT; pftid++) {
+          AllPFTs = AllPFTs + pctpft[pftid * pftstep];
+      }
+      outAllPFTsdblGrid[landid] = AllPFTs;
+      pctcft = writeset->PCTCFTGrid[0] + landid * CFTPIXSTEP;
+      AllCFTs = 0.0;
+      for (cftid = 0; cftid < MAXCFT; cftid++) {
+          AllCFTs = AllCFTs + pctcft[cftid * cftstep];
+      }
+      outAllCFTsdblGrid[landid] = AllCFTs;
+  }
   
-  yearindex = prevyear - firstyear;
-  if (yearindex < 0) {
-      yearindex = 0;
+  return 0;
+
+}
+
+float *selectdblslicesource(outputgridset *writeset, int dblfield, int typeid) {
+
+  switch (dblfield) {
+      case DBLFIELD_PCTGLACIER: return inPCTGLACIERGrid;
+      case DBLFIELD_PCTLAKE: return inPCTLAKEGrid;
+      case DBLFIELD_PCTWETLAND: return inPCTWETLANDGrid;
+      case DBLFIELD_PCTURBAN: return inPCTURBANGrid;
+      case DBLFIELD_PCTCROP: return writeset->PCTCROPGrid;
+      case DBLFIELD_PCTNATVEG: return writeset->PCTCROPGrid;  /* natural vegetation is the remainder of the crop */
+      case DBLFIELD_PCTPFT: return writeset->PCTPFTGrid[typeid];
+      case DBLFIELD_PCTCFT: return writeset->PCTCFTGrid[typeid];
+      case DBLFIELD_FERTNITRO: return writeset->FERTNITROGrid[typeid];
+      case DBLFIELD_UNREPPFT: return writeset->UNREPPFTGrid[typeid];
+      case DBLFIELD_UNREPCFT: return writeset->UNREPCFTGrid[typeid];
+      case DBLFIELD_BIOHVH1: return writeset->BIOHVH1Grid;
+      case DBLFIELD_BIOHVH2: return writeset->BIOHVH2Grid;
+      case DBLFIELD_BIOHSH1: return writeset->BIOHSH1Grid;
+      case DBLFIELD_BIOHSH2: return writeset->BIOHSH2Grid;
+      case DBLFIELD_BIOHSH3: return writeset->BIOHSH3Grid;
   }
+
+  return NULL;
+
+}
+
+double generatedblvalue(int dblfield, int typeid, float *sourceGrid, long clmindex, long landid) {
+
+  /* one pixel of a double output slice - landid is the pixel's place in the land index or negative for a pixel */
+  /* that is not land, the reference sources are dense region grids and the year's sources are in land order - */
+  /* reading one type of a pixel major block here is the transposition back to the netCDF slice layout */
+
+  double scalelandunits, AllFrac, AllTypes, tempdblPCT;
+  long sourceindex;
+  int landpix, oceanpix;
   
-  openncinputfile(luhtransitionsdb); 
+  landpix = landid >= 0;
+  oceanpix = includeOcean == 0 && inLANDMASKGrid[clmindex] == 0.0;
+  AllFrac = 0.0;
+  if (landpix) {
+      AllFrac = outAllFracdblGrid[landid];
+  }
+  sourceindex = landid;
+  if (dblfield >= DBLFIELD_PCTGLACIER && dblfield <= DBLFIELD_PCTURBAN) {
+      sourceindex = clmindex;
+  }
+  if (dblfield == DBLFIELD_PCTPFT || dblfield == DBLFIELD_UNREPPFT) {
+      sourceindex = landid * PFTPIXSTEP;
+  }
+  if (dblfield == DBLFIELD_PCTCFT || dblfield == DBLFIELD_FERTNITRO || dblfield == DBLFIELD_UNREPCFT) {
+      sourceindex = landid * CFTPIXSTEP;
+  }
+  tempdblPCT = 0.0;
+          
+  switch (dblfield) {
+      case DBLFIELD_LANDFRAC:
+          if (landpix) {
+              tempdblPCT = inLANDFRACGrid[clmindex];
+          }
+          if (includeOcean == 0) {
+              tempdblPCT = 1.0;
+          }
+          break;
+      case DBLFIELD_AREA:
+          tempdblPCT = inAREAGrid[clmindex];
+          break;
+      case DBLFIELD_PCTGLACIER:
+      case DBLFIELD_PCTLAKE:
+      case DBLFIELD_PCTWETLAND:
+      case DBLFIELD_PCTURBAN:
+      case DBLFIELD_PCTCROP:
+      case DBLFIELD_PCTNATVEG:
+          if (landpix) {
+              tempdblPCT = sourceGrid[sourceindex];
+              if (dblfield == DBLFIELD_PCTCROP && AllFrac == 0.0) {
+                  tempdblPCT = 0.0;
+              }
+              if (dblfield == DBLFIELD_PCTNATVEG) {
+                  tempdblPCT = 100.0 - tempdblPCT;
+                  if (AllFrac == 0.0) {
+                      tempdblPCT = 100.0;
+                  }
+              }
+          }
+          if (includeOcean == 0) {
+              /* land units rescaled to the whole grid cell with the ocean as lake - ocean pixels end up 100% lake */
+              scalelandunits = 0.0;
+              if (landpix) {
+                  scalelandunits = inLANDFRACGrid[clmindex];
+              }
+              if (dblfield == DBLFIELD_PCTLAKE) {
+                  tempdblPCT = scalelandunits * tempdblPCT + (1.0 - scalelandunits) * 100.0;
+              }
+              else {
+                  tempdblPCT = scalelandunits * tempdblPCT;
+              }
+          }
+          break;
+      case DBLFIELD_PCTPFT:
+      case DBLFIELD_PCTCFT:
+          AllTypes = 0.0;
+          if (landpix && dblfield == DBLFIELD_PCTPFT) {
+              AllTypes = outAllPFTsdblGrid[landid];
+          }
+          if (landpix && dblfield == DBLFIELD_PCTCFT) {
+              AllTypes = outAllCFTsdblGrid[landid];
+          }
+          if ((landpix && (AllFrac == 0.0 || AllTypes == 0.0)) || oceanpix) {
+              if (typeid == 0) {
+                  tempdblPCT = 100.0;
+              }
+          }
+          else if (landpix) {
+              tempdblPCT = sourceGrid[sourceindex];
+              tempdblPCT = tempdblPCT * 100.0 / AllTypes;
+          }
+          break;
+      default:
+          if (landpix && AllFrac != 0.0) {
+              tempdblPCT = sourceGrid[sourceindex];
+          }
+          break;
+  }
+
+  return tempdblPCT;
+
+}
+
+int generatedblslice(outputgridset *writeset, int dblfield, int typeid, double *sliceGrid) {
+
+  /* one double output slice of the year into sliceGrid - the normalization to 100%, the ocean swap and the */
+  /* float to double widening are all done here pixel by pixel so no full double copy of the year is ever held - */
+  /* this is where the year's land order results are put back on the dense grid */
+
+  float *sourceGrid;
+  long clmlin, clmpix, clmindex, landid;
   
-  readnc3dfield("c4ann_to_secdn",yearindex,translossGrid,flipLUHgrids);
+  sourceGrid = selectdblslicesource(writeset,dblfield,typeid);
 
-  readnc3dfield("c4ann_to_urban",yearindex,tempGrid,flipLUHgrids);
   for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
       for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
+          clmindex = clmlin * MAXOUTPIX + clmpix;
+          sliceGrid[clmindex] = generatedblvalue(dblfield,typeid,sourceGrid,clmindex,-1);
       }
   }
 
-  readnc3dfield("c4ann_to_c3ann",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
+  for (landid = 0; landid < landpixcount; landid++) {
+      clmindex = landpixindex[landid];
+      sliceGrid[clmindex] = generatedblvalue(dblfield,typeid,sourceGrid,clmindex,landid);
   }
+  
+  return 0;
+
+}
 
-  readnc3dfield("c4ann_to_secdf",yearindex,tempGrid,flipLUHgrids);
+int generatelandmaskslice() {
+
+  /* with the ocean swapped to lake every pixel of the output is land */
+
+  long clmlin, clmpix;
+  
   for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
       for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
+          if (includeOcean == 0 && inLANDMASKGrid[clmlin * MAXOUTPIX + clmpix] == 0.0) {
+              outsliceGrid[clmlin * MAXOUTPIX + clmpix] = 1.0;
+          }
+          else {
+              outsliceGrid[clmlin * MAXOUTPIX + clmpix] = inLANDMASKGrid[clmlin * MAXOUTPIX + clmpix];
+          }
       }
   }
 
-  readnc3dfield("c4ann_to_c3per",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
+  return 0;
+
+}
+
+int writedblfield(outputgridset *writeset, int varid, int dblfield, int typecount) {
+
+  /* generate and write the field outslicedepth slices at a time - typecount 0 is a 2d grid, otherwise the number */
+  /* of types of a 3d field - a write starts on a multiple of the chunk depth so it only covers whole chunks and a */
+  /* compressed chunk is never read back to be patched - only the netCDF call holds ncaccessmutex so the reader */
+  /* thread is not held up by the conversion */
+
+  int typeid, sliceid, slicecount;
+
+  if (typecount == 0) {
+      generatedblslice(writeset,dblfield,0,outslicedblGrid);
+      pthread_mutex_lock(&ncaccessmutex);
+      writenc2ddblfield(varid,outslicedblGrid);
+      pthread_mutex_unlock(&ncaccessmutex);
+      return 0;
   }
 
-  readnc3dfield("c4ann_to_c4per",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
+  for (typeid = 0; typeid < typecount; typeid += slicecount) {
+      slicecount = outslicedepth;
+      if (typeid + slicecount > typecount) {
+          slicecount = typecount - typeid;
       }
+      for (sliceid = 0; sliceid < slicecount; sliceid++) {
+          generatedblslice(writeset,dblfield,typeid + sliceid,outslicedblGrid + sliceid * MAXOUTPIX * MAXOUTLIN);
+      }
+      pthread_mutex_lock(&ncaccessmutex);
+      writenc3ddblfield(varid,typeid,slicecount,outslicedblGrid);
+      pthread_mutex_unlock(&ncaccessmutex);
   }
 
-  readnc3dfield("c4ann_to_c3nfx",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
+  return 0;
+
+}
+
+
+int writestaticgrids() {
+
+  /* fields without a latitude dimension are written once by rank 0 in the first tile - the rest by every rank for its band */
+
+  if (mpirank == 0 && currenttile == 0) {
+      writenc1dintfield(natpft_id,innatpft);
+      writenc1dintfield(cft_id,incft);
+      writenc0dfield(EDGEN_id,&inEDGEN);
+      writenc0dfield(EDGEE_id,&inEDGEE);
+      writenc0dfield(EDGES_id,&inEDGES);
+      writenc0dfield(EDGEW_id,&inEDGEW);
+      writenc1dfield(LON_id,inLON,0,MAXOUTPIX);
   }
+  writenc1dfield(LAT_id,inLAT,OUTBANDLATOFFSET,MAXOUTLIN);
+  writenc2dfield(LATIXY_id,inLATIXY);
+  writenc2dfield(LONGXY_id,inLONGXY);
 
-  readnc3dfield("c4ann_to_pastr",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
+  return 0;
+
+}
+
+int
+inqncoutputvarid(char *varname, int *varid) {
+
+    int stat;
+
+    stat = nc_inq_varid(outncid, varname, varid);
+    check_err(stat,__LINE__,__FILE__);
+
+    return 0;
+
+}
+
+int
+inqncoutputgridvarid(char *varname, int *varid) {
+
+    /* gridded and record variables of a reopened file are independent again - every rank writes them collectively */
+
+#ifdef USEMPI
+    int stat;
+#endif
+
+    inqncoutputvarid(varname,varid);
+
+#ifdef USEMPI
+    stat = nc_var_par_access(outncid, *varid, NC_COLLECTIVE);
+    check_err(stat,__LINE__,__FILE__);
+#endif
+
+    return 0;
+
+}
+
+int
+inqncoutputvarids() {
+
+    /* the variable ids of an existing output file - time series files also have YEAR */
+
+    inqncoutputvarid("natpft",&natpft_id);
+    inqncoutputvarid("cft",&cft_id);
+    inqncoutputvarid("EDGEN",&EDGEN_id);
+    inqncoutputvarid("EDGEE",&EDGEE_id);
+    inqncoutputvarid("EDGES",&EDGES_id);
+    inqncoutputvarid("EDGEW",&EDGEW_id);
+    inqncoutputvarid("LAT",&LAT_id);
+    inqncoutputgridvarid("LATIXY",&LATIXY_id);
+    inqncoutputvarid("LON",&LON_id);
+    inqncoutputgridvarid("LONGXY",&LONGXY_id);
+    inqncoutputgridvarid("LANDMASK",&LANDMASK_id);
+    inqncoutputgridvarid("LANDFRAC",&LANDFRAC_id);
+    inqncoutputgridvarid("AREA",&AREA_id);
+    inqncoutputgridvarid("PCT_GLACIER",&PCT_GLACIER_id);
+    inqncoutputgridvarid("PCT_LAKE",&PCT_LAKE_id);
+    inqncoutputgridvarid("PCT_WETLAND",&PCT_WETLAND_id);
+    inqncoutputgridvarid("PCT_URBAN",&PCT_URBAN_id);
+    inqncoutputgridvarid("PCT_NATVEG",&PCT_NATVEG_id);
+    inqncoutputgridvarid("PCT_CROP",&PCT_CROP_id);
+    inqncoutputgridvarid("PCT_NAT_PFT",&PCT_NAT_PFT_id);
+    inqncoutputgridvarid("PCT_CFT",&PCT_CFT_id);
+    inqncoutputgridvarid("FERTNITRO_CFT",&FERTNITRO_CFT_id);
+    inqncoutputgridvarid("UNREPRESENTED_PFT_LULCC",&UNREPRESENTED_PFT_LULCC_id);
+    inqncoutputgridvarid("UNREPRESENTED_CFT_LULCC",&UNREPRESENTED_CFT_LULCC_id);
+    inqncoutputgridvarid("HARVEST_VH1",&HARVEST_VH1_id);
+    inqncoutputgridvarid("HARVEST_VH2",&HARVEST_VH2_id);
+    inqncoutputgridvarid("HARVEST_SH1",&HARVEST_SH1_id);
+    inqncoutputgridvarid("HARVEST_SH2",&HARVEST_SH2_id);
+    inqncoutputgridvarid("HARVEST_SH3",&HARVEST_SH3_id);
+    if (outputtimeseries > 0) {
+        inqncoutputgridvarid("YEAR",&YEAR_id);
+    }
+
+    return 0;
+
+}
+
+int
+openncoutputseries() {
+
+    /* one time series file for the whole run - outputtimeseries 1 starts a new file and 2 appends to an existing */
+    /* file, where each year goes to record year - first year on file so a run may also rewrite its last years */
+
+    char outncfilename[1024];
+    FILE *seriesfile;
+    int stat;
+    size_t timelen, start[1], count[1];
+
+    sprintf(outncfilename,"%s/%s.nc",outputdir,outputseries);
+
+    /* tiles after the first always add their rows to the file the first tile started */
+
+    seriesfile = NULL;
+    if (outputtimeseries == 2 || currenttile > 0) {
+        seriesfile = fopen(outncfilename,"r");
+    }
+    if (seriesfile == NULL) {
+        createncoutputfile(outncfilename);
+        writestaticgrids();
+        outputseriesfirstyear = startyear;
+        return 0;
+    }
+    fclose(seriesfile);
+
+    openncoutputfile(outncfilename);
+
+    stat = nc_inq_dimid(outncid, "time", &time_dim);
+    check_err(stat,__LINE__,__FILE__);
+    stat = nc_inq_dimlen(outncid, time_dim, &timelen);
+    check_err(stat,__LINE__,__FILE__);
+
+    inqncoutputvarids();
+    if (currenttile > 0) {
+        writestaticgrids();
+    }
+
+    outputseriesfirstyear = startyear;
+    if (timelen > 0) {
+        start[0] = 0;
+        count[0] = 1;
+        stat = nc_get_vara_int(outncid, YEAR_id, start, count, &outputseriesfirstyear);
+        check_err(stat,__LINE__,__FILE__);
+    }
+
+    if (startyear < outputseriesfirstyear || startyear > outputseriesfirstyear + (long) timelen) {
+        printf("Time series %s holds years %d to %ld - cannot append from %d\n",outncfilename,outputseriesfirstyear,outputseriesfirstyear + (long) timelen - 1,startyear);
+        exit(1);
+    }
+    printf("Appending to time series %s from year %d\n",outncfilename,startyear);
+
+    return 0;
+
+}
+
+int writegrids(outputgridset *writeset) {
+
+  char outncfilename[1024];
+  int stat;
+  size_t start[1], count[1];
+
+  generatedblsums(writeset);
+
+  pthread_mutex_lock(&ncaccessmutex);
+  if (outputtimeseries == 0) {
+      /* the first tile creates the year's file and later tiles add their rows to it */
+      sprintf(outncfilename,"%s/%s_%d.nc",outputdir,outputseries,writeset->year);
+      if (currenttile == 0) {
+          createncoutputfile(outncfilename);
+      }
+      else {
+          openncoutputfile(outncfilename);
+          inqncoutputvarids();
       }
+      writestaticgrids();
   }
-
-  readnc3dfield("c4ann_to_range",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          totaltransloss = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-          unreploss = totaltransloss - (inPREVC4ANNGrid[clmlin * MAXOUTPIX + clmpix] - inCURRC4ANNGrid[clmlin * MAXOUTPIX + clmpix]);
-          if (unreploss < 0.0) {
-              unreploss = 0.0;
-          }
-          inUNREPC4ANNGrid[clmlin * MAXOUTPIX + clmpix] = unreploss;
+  else {
+      /* YEAR is collective in MPI runs - only rank 0 puts the value */
+      outputrecord = writeset->year - outputseriesfirstyear;
+      start[0] = outputrecord;
+      count[0] = 1;
+      if (mpirank != 0) {
+          count[0] = 0;
       }
+      stat = nc_put_vara_int(outncid, YEAR_id, start, count, &writeset->year);
+      check_err(stat,__LINE__,__FILE__);
   }
-
-  closencfile();
+  pthread_mutex_unlock(&ncaccessmutex);
+  
+  generatelandmaskslice();
+  pthread_mutex_lock(&ncaccessmutex);
+  writenc2dfield(LANDMASK_id,outsliceGrid);
+  pthread_mutex_unlock(&ncaccessmutex);
+
+  writedblfield(writeset,LANDFRAC_id,DBLFIELD_LANDFRAC,0);
+  writedblfield(writeset,AREA_id,DBLFIELD_AREA,0);
+  writedblfield(writeset,PCT_GLACIER_id,DBLFIELD_PCTGLACIER,0);
+  writedblfield(writeset,PCT_LAKE_id,DBLFIELD_PCTLAKE,0);
+  writedblfield(writeset,PCT_WETLAND_id,DBLFIELD_PCTWETLAND,0);
+  writedblfield(writeset,PCT_URBAN_id,DBLFIELD_PCTURBAN,0);
+  writedblfield(writeset,PCT_NATVEG_id,DBLFIELD_PCTNATVEG,0);
+  writedblfield(writeset,PCT_CROP_id,DBLFIELD_PCTCROP,0);
+  
+  writedblfield(writeset,PCT_NAT_PFT_id,DBLFIELD_PCTPFT,MAXPFT);
+  writedblfield(writeset,PCT_CFT_id,DBLFIELD_PCTCFT,MAXCFT);
+  writedblfield(writeset,FERTNITRO_CFT_id,DBLFIELD_FERTNITRO,MAXCFT);
+  writedblfield(writeset,UNREPRESENTED_PFT_LULCC_id,DBLFIELD_UNREPPFT,MAXPFT);
+  writedblfield(writeset,UNREPRESENTED_CFT_LULCC_id,DBLFIELD_UNREPCFT,MAXCFT);
+
+  writedblfield(writeset,HARVEST_VH1_id,DBLFIELD_BIOHVH1,0);
+  writedblfield(writeset,HARVEST_VH2_id,DBLFIELD_BIOHVH2,0);
+  writedblfield(writeset,HARVEST_SH1_id,DBLFIELD_BIOHSH1,0);
+  writedblfield(writeset,HARVEST_SH2_id,DBLFIELD_BIOHSH2,0);
+  writedblfield(writeset,HARVEST_SH3_id,DBLFIELD_BIOHSH3,0);
+
+  pthread_mutex_lock(&ncaccessmutex);
+  if (outputtimeseries == 0) {
+      closencoutputfile();
+  }
+  else {
+      /* flush every record so a run that stops early leaves a time series that can be appended to */
+      stat = nc_sync(outncid);
+      check_err(stat,__LINE__,__FILE__);
+  }
+  pthread_mutex_unlock(&ncaccessmutex);
   
   return 0;
-  
+
 }
 
 
-int readUNREPC3PERGrids(int prevyear) {
+void *inputreaderloop(void *arg) {
 
-  int yearindex;
-  long clmlin, clmpix;
-  float totaltransloss;
-  float unreploss;
-  
-  yearindex = prevyear - firstyear;
-  if (yearindex < 0) {
-      yearindex = 0;
-  }
-  
-  openncinputfile(luhtransitionsdb); 
-  
-  readnc3dfield("c3per_to_secdn",yearindex,translossGrid,flipLUHgrids);
+  /* read every year in order into the input sets - a set is only refilled after its year worker releases it */
+
+  inputgridset *readset, *prevset;
+  int yearnumber;
 
-  readnc3dfield("c3per_to_urban",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+  prevset = NULL;
+  for (yearnumber = startyear; yearnumber <= endyear; yearnumber++) {
+      readset = &inputgridsets[(yearnumber - startyear) % inputgridsetcount];
 
-  readnc3dfield("c3per_to_c3ann",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
+      pthread_mutex_lock(&inputreadermutex);
+      while (readset->full == 1) {
+          pthread_cond_wait(&inputreadercond, &inputreadermutex);
       }
-  }
+      pthread_mutex_unlock(&inputreadermutex);
 
-  readnc3dfield("c3per_to_c4ann",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+      readLUHyearGrids(yearnumber,readset,prevset);
 
-  readnc3dfield("c3per_to_secdf",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+      pthread_mutex_lock(&inputreadermutex);
+      readset->year = yearnumber;
+      readset->full = 1;
+      pthread_cond_broadcast(&inputreadercond);
+      pthread_mutex_unlock(&inputreadermutex);
 
-  readnc3dfield("c3per_to_c4per",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
+      prevset = readset;
   }
 
-  readnc3dfield("c3per_to_c3nfx",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+  freefliprow();
 
-  readnc3dfield("c3per_to_pastr",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+  return NULL;
 
-  readnc3dfield("c3per_to_range",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          totaltransloss = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-          unreploss = totaltransloss - (inPREVC3PERGrid[clmlin * MAXOUTPIX + clmpix] - inCURRC3PERGrid[clmlin * MAXOUTPIX + clmpix]);
-          if (unreploss < 0.0) {
-              unreploss = 0.0;
-          }
-          inUNREPC3PERGrid[clmlin * MAXOUTPIX + clmpix] = unreploss;
-      }
+}
+
+int startinputreader() {
+
+  int setid;
+
+  for (setid = 0; setid < inputgridsetcount; setid++) {
+      inputgridsets[setid].full = 0;
+  }
+  if (pthread_create(&inputreaderthread, NULL, inputreaderloop, NULL) != 0) {
+      fprintf(stderr,"Unable to start input reader thread\n");
+      exit(1);
   }
 
-  closencfile();
-  
   return 0;
-  
+
 }
 
+int acquireinputgridset(int currentyear) {
 
-int readUNREPC4PERGrids(int prevyear) {
+  inputgridset *readset;
 
-  int yearindex;
-  long clmlin, clmpix;
-  float totaltransloss;
-  float unreploss;
-  
-  yearindex = prevyear - firstyear;
-  if (yearindex < 0) {
-      yearindex = 0;
-  }
-  
-  openncinputfile(luhtransitionsdb); 
-  
-  readnc3dfield("c4per_to_secdn",yearindex,translossGrid,flipLUHgrids);
+  readset = &inputgridsets[(currentyear - startyear) % inputgridsetcount];
 
-  readnc3dfield("c4per_to_urban",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
+  pthread_mutex_lock(&inputreadermutex);
+  while (readset->full == 0 || readset->year != currentyear) {
+      pthread_cond_wait(&inputreadercond, &inputreadermutex);
   }
+  pthread_mutex_unlock(&inputreadermutex);
 
-  readnc3dfield("c4per_to_c3ann",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+  selectinputgridset(readset);
 
-  readnc3dfield("c4per_to_c4ann",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+  return 0;
 
-  readnc3dfield("c4per_to_c3per",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+}
 
-  readnc3dfield("c4per_to_secdf",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+int releaseinputgridset(int currentyear) {
 
-  readnc3dfield("c4per_to_c3nfx",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+  inputgridset *readset;
 
-  readnc3dfield("c4per_to_pastr",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+  readset = &inputgridsets[(currentyear - startyear) % inputgridsetcount];
 
-  readnc3dfield("c4per_to_range",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          totaltransloss = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-          unreploss = totaltransloss - (inPREVC4PERGrid[clmlin * MAXOUTPIX + clmpix] - inCURRC4PERGrid[clmlin * MAXOUTPIX + clmpix]);
-          if (unreploss < 0.0) {
-              unreploss = 0.0;
-          }
-          inUNREPC4PERGrid[clmlin * MAXOUTPIX + clmpix] = unreploss;
-      }
-  }
+  pthread_mutex_lock(&inputreadermutex);
+  readset->full = 0;
+  pthread_cond_broadcast(&inputreadercond);
+  pthread_mutex_unlock(&inputreadermutex);
 
-  closencfile();
-  
   return 0;
-  
+
 }
 
+int finishinputreader() {
 
-int readUNREPC3NFXGrids(int prevyear) {
+  pthread_join(inputreaderthread, NULL);
 
-  int yearindex;
-  long clmlin, clmpix;
-  float totaltransloss;
-  float unreploss;
-  
-  yearindex = prevyear - firstyear;
-  if (yearindex < 0) {
-      yearindex = 0;
-  }
-  
-  openncinputfile(luhtransitionsdb); 
-  
-  readnc3dfield("c3nfx_to_secdn",yearindex,translossGrid,flipLUHgrids);
+  return 0;
 
-  readnc3dfield("c3nfx_to_urban",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+}
 
-  readnc3dfield("c3nfx_to_c3ann",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+void *outputwriterloop(void *arg) {
 
-  readnc3dfield("c3nfx_to_c4ann",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+  /* write every year in order - a set is handed back to the year workers once its file is closed */
 
-  readnc3dfield("c3nfx_to_c3per",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+  outputgridset *writeset;
+  phaseclock clock;
+  int yearnumber;
 
-  readnc3dfield("c3nfx_to_c4per",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+  for (yearnumber = startyear; yearnumber <= endyear; yearnumber++) {
+      writeset = &outputgridsets[(yearnumber - startyear) % outputgridsetcount];
 
-  readnc3dfield("c3nfx_to_secdf",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
+      pthread_mutex_lock(&outputwritermutex);
+      while (writeset->full == 0 || writeset->year != yearnumber) {
+          pthread_cond_wait(&outputwritercond, &outputwritermutex);
       }
-  }
+      pthread_mutex_unlock(&outputwritermutex);
 
-  readnc3dfield("c3nfx_to_pastr",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
+      startphase(&clock);
+      writegrids(writeset);
+      endphase(&clock,PHASE_WRITE,yearnumber,MAXOUTPIX * MAXOUTLIN,1);
+
+      pthread_mutex_lock(&outputwritermutex);
+      writeset->full = 0;
+      outputwrittenyear = yearnumber;
+      pthread_cond_broadcast(&outputwritercond);
+      pthread_mutex_unlock(&outputwritermutex);
   }
 
-  readnc3dfield("c3nfx_to_range",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          totaltransloss = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-          unreploss = totaltransloss - (inPREVC3NFXGrid[clmlin * MAXOUTPIX + clmpix] - inCURRC3NFXGrid[clmlin * MAXOUTPIX + clmpix]);
-          if (unreploss < 0.0) {
-              unreploss = 0.0;
-          }
-          inUNREPC3NFXGrid[clmlin * MAXOUTPIX + clmpix] = unreploss;
-      }
+  return NULL;
+
+}
+
+int startoutputwriter() {
+
+  int setid;
+
+  for (setid = 0; setid < outputgridsetcount; setid++) {
+      outputgridsets[setid].full = 0;
   }
+  if (pthread_create(&outputwriterthread, NULL, outputwriterloop, NULL) != 0) {
+      fprintf(stderr,"Unable to start output writer thread\n");
+      exit(1);
+  }
+  outputwrittenyear = startyear - 1;
+  outputwriterrunning = 1;
 
-  closencfile();
-  
   return 0;
-  
+
 }
 
+int acquireoutputgridset(int currentyear) {
 
-int readUNREPPASTRGrids(int prevyear) {
+  /* block until the writer has written the year that last used this set - a worker may run a whole ring ahead of */
+  /* a slow worker, so the set being empty is not enough - returns 1 once the writer has failed */
 
-  int yearindex;
-  long clmlin, clmpix;
-  float totaltransloss;
-  float unreploss;
-  
-  yearindex = prevyear - firstyear;
-  if (yearindex < 0) {
-      yearindex = 0;
-  }
-  
-  openncinputfile(luhtransitionsdb); 
-  
-  readnc3dfield("pastr_to_secdn",yearindex,translossGrid,flipLUHgrids);
+  outputgridset *writeset;
 
-  readnc3dfield("pastr_to_urban",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+  writeset = &outputgridsets[(currentyear - startyear) % outputgridsetcount];
 
-  readnc3dfield("pastr_to_c3ann",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
+  pthread_mutex_lock(&outputwritermutex);
+  while ((writeset->full == 1 || currentyear - outputgridsetcount > outputwrittenyear) && outputwritererrorstat == NC_NOERR) {
+      pthread_cond_wait(&outputwritercond, &outputwritermutex);
   }
+  pthread_mutex_unlock(&outputwritermutex);
 
-  readnc3dfield("pastr_to_c4ann",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
+  if (outputwritererrorstat != NC_NOERR) {
+      return 1;
   }
 
-  readnc3dfield("pastr_to_c3per",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+  selectoutputgridset(writeset);
 
-  readnc3dfield("pastr_to_c4per",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+  return 0;
 
-  readnc3dfield("pastr_to_c3nfx",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+}
 
-  readnc3dfield("pastr_to_secdf",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+int queueoutputgridset(int currentyear) {
 
-  readnc3dfield("pastr_to_range",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          totaltransloss = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-          unreploss = totaltransloss - (inPREVPASTRGrid[clmlin * MAXOUTPIX + clmpix] - inCURRPASTRGrid[clmlin * MAXOUTPIX + clmpix]);
-          if (unreploss < 0.0) {
-              unreploss = 0.0;
-          }
-          inUNREPPASTRGrid[clmlin * MAXOUTPIX + clmpix] = unreploss;
-      }
-  }
+  outputgridset *writeset;
+
+  writeset = &outputgridsets[(currentyear - startyear) % outputgridsetcount];
+
+  pthread_mutex_lock(&outputwritermutex);
+  writeset->year = currentyear;
+  writeset->full = 1;
+  pthread_cond_broadcast(&outputwritercond);
+  pthread_mutex_unlock(&outputwritermutex);
 
-  closencfile();
-  
   return 0;
-  
+
 }
 
+int finishoutputwriter() {
 
-int readUNREPRANGEGrids(int prevyear) {
+  /* a writer error ends the run here */
 
-  int yearindex;
-  long clmlin, clmpix;
-  float totaltransloss;
-  float unreploss;
-  
-  yearindex = prevyear - firstyear;
-  if (yearindex < 0) {
-      yearindex = 0;
-  }
-  
-  openncinputfile(luhtransitionsdb); 
-  
-  readnc3dfield("range_to_secdn",yearindex,translossGrid,flipLUHgrids);
+  pthread_join(outputwriterthread, NULL);
+  outputwriterrunning = 0;
 
-  readnc3dfield("range_to_urban",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
+  if (outputwritererrorstat != NC_NOERR) {
+      (void)fprintf(stderr,"line %d of %s: %s\n", outputwritererrorline, __FILE__, nc_strerror(outputwritererrorstat));
+      fflush(stderr);
+      exit(1);
   }
 
-  readnc3dfield("range_to_c3ann",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+  return 0;
 
-  readnc3dfield("range_to_c4ann",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+}
 
-  readnc3dfield("range_to_c3per",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+int generatelandrange(long landstart, long landend) {
 
-  readnc3dfield("range_to_c4per",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+  /* every kernel for one run of the land index, fused one block of KERNELBLOCKLAND pixels at a time - a block's */
+  /* intermediates stay in the calling thread's kernel scratch and only the output set grids go out to memory - */
+  /* the kernels only read and write the pixels they are given so any split of the index gives the same values */
 
-  readnc3dfield("range_to_c3nfx",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-      }
-  }
+  long blockstart, blockend;
 
-  readnc3dfield("range_to_pastr",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          translossGrid[clmlin * MAXOUTPIX + clmpix] = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
+  for (blockstart = landstart; blockstart < landend; blockstart += KERNELBLOCKLAND) {
+      blockend = blockstart + KERNELBLOCKLAND;
+      if (blockend > landend) {
+          blockend = landend;
       }
+
+      initializeGrids(blockstart,blockend);
+
+      generateLUHcollectionGrids(blockstart,blockend);
+      generateclmPFTGrids(blockstart,blockend);
+      generateclmCFTGrids(blockstart,blockend);
+      generateclmwoodharvestGrids(blockstart,blockend);
   }
 
-  readnc3dfield("range_to_secdf",yearindex,tempGrid,flipLUHgrids);
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          totaltransloss = translossGrid[clmlin * MAXOUTPIX + clmpix] + tempGrid[clmlin * MAXOUTPIX + clmpix];
-          unreploss = totaltransloss - (inPREVRANGEGrid[clmlin * MAXOUTPIX + clmpix] - inCURRRANGEGrid[clmlin * MAXOUTPIX + clmpix]);
-          if (unreploss < 0.0) {
-              unreploss = 0.0;
-          }
-          inUNREPRANGEGrid[clmlin * MAXOUTPIX + clmpix] = unreploss;
+  return 0;
+
+}
+
+int generatekernelchunks(yearcontext *context) {
+
+  /* claim and generate chunks of the current year until none are left - the last thread out wakes the year worker */
+
+  long chunkid, landstart, landend;
+
+  while (1) {
+      pthread_mutex_lock(&context->kernelmutex);
+      chunkid = context->kernelnextchunk;
+      context->kernelnextchunk++;
+      pthread_mutex_unlock(&context->kernelmutex);
+
+      if (chunkid >= context->kernelchunkcount) {
+          break;
       }
+      landstart = chunkid * context->kernelchunkland;
+      landend = landstart + context->kernelchunkland;
+      if (landend > landpixcount) {
+          landend = landpixcount;
+      }
+      generatelandrange(landstart,landend);
   }
 
-  closencfile();
-  
+  pthread_mutex_lock(&context->kernelmutex);
+  context->kernelbusy--;
+  if (context->kernelbusy == 0) {
+      pthread_cond_broadcast(&context->kerneldonecond);
+  }
+  pthread_mutex_unlock(&context->kernelmutex);
+
   return 0;
-  
+
 }
 
+void *kernelthreadloop(void *arg) {
 
-int readLUHcropmanagementGrids(int curryear) {
+  /* a kernel thread points its per year globals at the year its worker hands out and helps generate it - */
+  /* a negative job ends the thread */
 
-  int yearindex;
-  long clmlin, clmpix;
-  float totaltransloss;
-  float unreploss;
-  
-  yearindex = curryear - firstyear;
-  if (yearindex < 0) {
-      yearindex = 0;
+  yearcontext *context;
+  phaseclock clock;
+  int job, yearnumber;
+
+  context = (yearcontext *) arg;
+  createkernelscratch();
+
+  job = 0;
+  while (1) {
+      pthread_mutex_lock(&context->kernelmutex);
+      while (context->kerneljob == job) {
+          pthread_cond_wait(&context->kernelstartcond, &context->kernelmutex);
+      }
+      job = context->kerneljob;
+      yearnumber = context->kernelyear;
+      pthread_mutex_unlock(&context->kernelmutex);
+
+      if (job < 0) {
+          break;
+      }
+
+      selectinputgridset(&inputgridsets[(yearnumber - startyear) % inputgridsetcount]);
+      selectoutputgridset(&outputgridsets[(yearnumber - startyear) % outputgridsetcount]);
+      startphase(&clock);
+      generatekernelchunks(context);
+      endphase(&clock,PHASE_GENERATE,yearnumber,0,0);
   }
-  
-  openncinputfile(luhmanagementdb); 
-  
-  readnc3dfield("fertl_c3ann",yearindex,inFERTC3ANNGrid,flipLUHgrids);
-  readnc3dfield("fertl_c4ann",yearindex,inFERTC4ANNGrid,flipLUHgrids);
-  readnc3dfield("fertl_c3per",yearindex,inFERTC3PERGrid,flipLUHgrids);
-  readnc3dfield("fertl_c4per",yearindex,inFERTC4PERGrid,flipLUHgrids);
-  readnc3dfield("fertl_c3nfx",yearindex,inFERTC3NFXGrid,flipLUHgrids);
-  readnc3dfield("irrig_c3ann",yearindex,inIRRIGC3ANNGrid,flipLUHgrids);
-  readnc3dfield("irrig_c4ann",yearindex,inIRRIGC4ANNGrid,flipLUHgrids);
-  readnc3dfield("irrig_c3per",yearindex,inIRRIGC3PERGrid,flipLUHgrids);
-  readnc3dfield("irrig_c4per",yearindex,inIRRIGC4PERGrid,flipLUHgrids);
-  readnc3dfield("irrig_c3nfx",yearindex,inIRRIGC3NFXGrid,flipLUHgrids);
 
-  closencfile();
-  
-  return 0;
-  
+  freekernelscratch();
+
+  return NULL;
+
 }
 
-int generateLUHcollectionGrids() {
+int generateyearGrids(yearcontext *context, int yearnumber) {
 
-  long clmlin, clmpix;
-  
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-      
-          inBASEFORESTTOTALGrid[clmlin * MAXOUTPIX + clmpix] = inBASEPRIMFGrid[clmlin * MAXOUTPIX + clmpix] + inBASESECDFGrid[clmlin * MAXOUTPIX + clmpix];
-          inBASENONFORESTTOTALGrid[clmlin * MAXOUTPIX + clmpix] = inBASEPRIMNGrid[clmlin * MAXOUTPIX + clmpix] + inBASESECDNGrid[clmlin * MAXOUTPIX + clmpix];
-          inBASECROPTOTALGrid[clmlin * MAXOUTPIX + clmpix] = inBASEC3ANNGrid[clmlin * MAXOUTPIX + clmpix] + inBASEC4ANNGrid[clmlin * MAXOUTPIX + clmpix] + inBASEC3PERGrid[clmlin * MAXOUTPIX + clmpix] + inBASEC4PERGrid[clmlin * MAXOUTPIX + clmpix] + inBASEC3NFXGrid[clmlin * MAXOUTPIX + clmpix];
-           inBASEMISSINGGrid[clmlin * MAXOUTPIX + clmpix] = 1.0 - inBASEFORESTTOTALGrid[clmlin * MAXOUTPIX + clmpix] - inBASENONFORESTTOTALGrid[clmlin * MAXOUTPIX + clmpix] - inBASEPASTRGrid[clmlin * MAXOUTPIX + clmpix] - inBASERANGEGrid[clmlin * MAXOUTPIX + clmpix] - inBASECROPTOTALGrid[clmlin * MAXOUTPIX + clmpix];
-          if (inBASEMISSINGGrid[clmlin * MAXOUTPIX + clmpix] < 0.0) {
-              inBASEMISSINGGrid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-          }
-          if (inBASEMISSINGGrid[clmlin * MAXOUTPIX + clmpix] > 1.0) {
-              inBASEMISSINGGrid[clmlin * MAXOUTPIX + clmpix] = 1.0;
-          }
-          inBASEOTHERGrid[clmlin * MAXOUTPIX + clmpix] = inBASEPRIMNGrid[clmlin * MAXOUTPIX + clmpix] + inBASESECDNGrid[clmlin * MAXOUTPIX + clmpix] + inBASERANGEGrid[clmlin * MAXOUTPIX + clmpix] + inBASEMISSINGGrid[clmlin * MAXOUTPIX + clmpix];
-          inBASENATVEGGrid[clmlin * MAXOUTPIX + clmpix] = inBASEFORESTTOTALGrid[clmlin * MAXOUTPIX + clmpix] + inBASEPASTRGrid[clmlin * MAXOUTPIX + clmpix] + inBASEOTHERGrid[clmlin * MAXOUTPIX + clmpix];
-
-          inCURRFORESTTOTALGrid[clmlin * MAXOUTPIX + clmpix] = inCURRPRIMFGrid[clmlin * MAXOUTPIX + clmpix] + inCURRSECDFGrid[clmlin * MAXOUTPIX + clmpix];
-          inCURRNONFORESTTOTALGrid[clmlin * MAXOUTPIX + clmpix] = inCURRPRIMNGrid[clmlin * MAXOUTPIX + clmpix] + inCURRSECDNGrid[clmlin * MAXOUTPIX + clmpix];
-          inCURRCROPTOTALGrid[clmlin * MAXOUTPIX + clmpix] = inCURRC3ANNGrid[clmlin * MAXOUTPIX + clmpix] + inCURRC4ANNGrid[clmlin * MAXOUTPIX + clmpix] + inCURRC3PERGrid[clmlin * MAXOUTPIX + clmpix] + inCURRC4PERGrid[clmlin * MAXOUTPIX + clmpix] + inCURRC3NFXGrid[clmlin * MAXOUTPIX + clmpix];
-          inCURRMISSINGGrid[clmlin * MAXOUTPIX + clmpix] = 1.0 - inCURRFORESTTOTALGrid[clmlin * MAXOUTPIX + clmpix] - inCURRNONFORESTTOTALGrid[clmlin * MAXOUTPIX + clmpix] - inCURRPASTRGrid[clmlin * MAXOUTPIX + clmpix] - inCURRRANGEGrid[clmlin * MAXOUTPIX + clmpix] - inCURRCROPTOTALGrid[clmlin * MAXOUTPIX + clmpix];
-          if (inCURRMISSINGGrid[clmlin * MAXOUTPIX + clmpix] < 0.0) {
-              inCURRMISSINGGrid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-          }
-          if (inCURRMISSINGGrid[clmlin * MAXOUTPIX + clmpix] > 1.0) {
-              inCURRMISSINGGrid[clmlin * MAXOUTPIX + clmpix] = 1.0;
-          }
-          inCURROTHERGrid[clmlin * MAXOUTPIX + clmpix] = inCURRPRIMNGrid[clmlin * MAXOUTPIX + clmpix] + inCURRSECDNGrid[clmlin * MAXOUTPIX + clmpix] + inCURRRANGEGrid[clmlin * MAXOUTPIX + clmpix] + inCURRMISSINGGrid[clmlin * MAXOUTPIX + clmpix];
-          inCURRNATVEGGrid[clmlin * MAXOUTPIX + clmpix] = inCURRFORESTTOTALGrid[clmlin * MAXOUTPIX + clmpix] + inCURRPASTRGrid[clmlin * MAXOUTPIX + clmpix] + inCURROTHERGrid[clmlin * MAXOUTPIX + clmpix];
+  long chunkcount;
 
-          inUNREPFORESTGrid[clmlin * MAXOUTPIX + clmpix] = inUNREPSECDFGrid[clmlin * MAXOUTPIX + clmpix] - inHARVESTSH1Grid[clmlin * MAXOUTPIX + clmpix] - inHARVESTSH2Grid[clmlin * MAXOUTPIX + clmpix];
-          if (inUNREPFORESTGrid[clmlin * MAXOUTPIX + clmpix] < 0.0) {
-              inUNREPFORESTGrid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-          }
-          if (inUNREPFORESTGrid[clmlin * MAXOUTPIX + clmpix] > 1.0) {
-              inUNREPFORESTGrid[clmlin * MAXOUTPIX + clmpix] = 1.0;
-          }
-          inUNREPOTHERGrid[clmlin * MAXOUTPIX + clmpix] = inUNREPSECDNGrid[clmlin * MAXOUTPIX + clmpix] - inHARVESTSH3Grid[clmlin * MAXOUTPIX + clmpix];
-          if (inUNREPOTHERGrid[clmlin * MAXOUTPIX + clmpix] < 0.0) {
-              inUNREPOTHERGrid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-          }
-          if (inUNREPOTHERGrid[clmlin * MAXOUTPIX + clmpix] > 1.0) {
-              inUNREPOTHERGrid[clmlin * MAXOUTPIX + clmpix] = 1.0;
-          }
-      }
+  if (kernelthreads == 1) {
+      generatelandrange(0,landpixcount);
+      return 0;
   }
-            
+
+  chunkcount = kernelthreads * KERNELCHUNKSPERTHREAD;
+
+  pthread_mutex_lock(&context->kernelmutex);
+  context->kernelyear = yearnumber;
+  context->kernelchunkland = (landpixcount + chunkcount - 1) / chunkcount;
+  if (context->kernelchunkland < 1) {
+      context->kernelchunkland = 1;
+  }
+  context->kernelchunkcount = (landpixcount + context->kernelchunkland - 1) / context->kernelchunkland;
+  context->kernelnextchunk = 0;
+  context->kernelbusy = kernelthreads;
+  context->kerneljob++;
+  pthread_cond_broadcast(&context->kernelstartcond);
+  pthread_mutex_unlock(&context->kernelmutex);
+
+  generatekernelchunks(context);
+
+  pthread_mutex_lock(&context->kernelmutex);
+  while (context->kernelbusy > 0) {
+      pthread_cond_wait(&context->kerneldonecond, &context->kernelmutex);
+  }
+  pthread_mutex_unlock(&context->kernelmutex);
+
   return 0;
-  
+
 }
 
+int startkernelthreads(yearcontext *context) {
 
-int generateclmPFTGrids() {
+  int threadid;
 
-  long clmlin, clmpix;
-  int pftid;
-  float pctnatvegval, pctnatvegbase, forestunrepval, pastureunrepval, otherunrepval;
-  float foresttotalbaseval, foresttotalfracval, foresttotalfracdelta, foresttotalcurrentval;
-  float pasturebaseval, pasturefracval, pasturecurrentval, pasturefracdelta;
-  float otherbaseval, otherfracval, othercurrentval, otherfracdelta;
-  float currentpctforestpft, deltapctforestpft;
-  float currentpctpasturepft, deltapctpasturepft;
-  float currentpctotherpft, deltapctotherpft;
-  float unrepforestfrac, unrepotherfrac;
-  float newpctpft, unreppctpft, newpctpfttotal;
-  
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          if (inLANDMASKGrid[clmlin * MAXOUTPIX + clmpix] == 1) {
-              pctnatvegval = inCURRNATVEGGrid[clmlin * MAXOUTPIX + clmpix] * 100.0;
-              if (pctnatvegval > 0.0) {
-                  outPCTNATVEGGrid[clmlin * MAXOUTPIX + clmpix] = pctnatvegval;
-                  pctnatvegbase = inBASENATVEGGrid[clmlin * MAXOUTPIX + clmpix] * 100.0;
-                  forestunrepval = inUNREPFORESTGrid[clmlin * MAXOUTPIX + clmpix];
-                  otherunrepval = inUNREPOTHERGrid[clmlin * MAXOUTPIX + clmpix];
-                  if (pctnatvegbase > 0.0) {
-                      foresttotalbaseval = inBASEFORESTTOTALGrid[clmlin * MAXOUTPIX + clmpix] / pctnatvegbase * 100.0;
-                      foresttotalfracval = inCURRFORESTTOTALGrid[clmlin * MAXOUTPIX + clmpix] / pctnatvegval * 100.0;
-                      foresttotalfracdelta = foresttotalfracval - foresttotalbaseval;
-                      if (foresttotalfracdelta >= 0.0) {
-                          foresttotalcurrentval = foresttotalbaseval;
-                      }
-                      else {
-                          foresttotalcurrentval = foresttotalbaseval + foresttotalfracdelta;
-                          foresttotalfracdelta = 0.0;
-                      }
-                      pasturebaseval = inBASEPASTRGrid[clmlin * MAXOUTPIX + clmpix] / pctnatvegbase * 100.0;
-                      pasturefracval = inCURRPASTRGrid[clmlin * MAXOUTPIX + clmpix] / pctnatvegval * 100.0;
-                      pasturecurrentval = 0.0;
-                      pasturefracdelta = pasturefracval;
-                      otherbaseval = inBASEOTHERGrid[clmlin * MAXOUTPIX + clmpix] / pctnatvegbase * 100.0;
-                      otherfracval = inCURROTHERGrid[clmlin * MAXOUTPIX + clmpix] / pctnatvegval * 100.0;
-                      otherfracdelta = otherfracval - otherbaseval;
-                      if (otherfracdelta >= 0.0) {
-                          othercurrentval = otherbaseval;
-                      }
-                      else {
-                          othercurrentval = otherbaseval + otherfracdelta;
-                          otherfracdelta = 0.0;
-                      }
-                  }
-                  else {
-                      foresttotalcurrentval = 0.0;
-                      foresttotalfracdelta = inCURRFORESTTOTALGrid[clmlin * MAXOUTPIX + clmpix] / pctnatvegval * 100.0;
-                      pasturecurrentval = 0.0;
-                      pasturefracdelta = inCURRPASTRGrid[clmlin * MAXOUTPIX + clmpix] / pctnatvegval * 100.0;
-                      othercurrentval = 0.0;
-                      otherfracdelta = inCURROTHERGrid[clmlin * MAXOUTPIX + clmpix] / pctnatvegval * 100.0;
-                  }
-                  for (pftid = 0; pftid < MAXPFT; pftid++) {
-                      currentpctforestpft = foresttotalcurrentval * inCURRENTPCTPFTGrid[pftid][clmlin * MAXOUTPIX + clmpix];
-                      deltapctforestpft = foresttotalfracdelta * inFORESTPCTPFTGrid[pftid][clmlin * MAXOUTPIX + clmpix];
-                      unrepforestfrac = forestunrepval * (currentpctforestpft + deltapctforestpft) / 100.0;
-                      currentpctpasturepft = pasturecurrentval * inCURRENTPCTPFTGrid[pftid][clmlin * MAXOUTPIX + clmpix];
-                      deltapctpasturepft = pasturefracdelta * inPASTUREPCTPFTGrid[pftid][clmlin * MAXOUTPIX + clmpix];
-                      currentpctotherpft = othercurrentval * inCURRENTPCTPFTGrid[pftid][clmlin * MAXOUTPIX + clmpix];
-                      deltapctotherpft = otherfracdelta * inOTHERPCTPFTGrid[pftid][clmlin * MAXOUTPIX + clmpix];
-                      newpctpft = currentpctforestpft + deltapctforestpft + currentpctpasturepft + deltapctpasturepft + currentpctotherpft + deltapctotherpft;
-                      outPCTPFTGrid[pftid][clmlin * MAXOUTPIX + clmpix] = newpctpft;
-                      outUNREPPFTGrid[pftid][clmlin * MAXOUTPIX + clmpix] = unrepforestfrac;
-                  }
-                  newpctpfttotal = 0.0;
-                  for (pftid = 0; pftid < MAXPFT; pftid++) {
-                      newpctpfttotal = newpctpfttotal + outPCTPFTGrid[pftid][clmlin * MAXOUTPIX + clmpix];
-                  }
-                  if (newpctpfttotal > 0.0) {
-                      for (pftid = 0; pftid < MAXPFT; pftid++) {
-                          newpctpft = outPCTPFTGrid[pftid][clmlin * MAXOUTPIX + clmpix];
-                          if (newpctpft > 0.0) {
-                              newpctpft = newpctpft / newpctpfttotal * 100.0;
-                              unreppctpft = unreppctpft / newpctpfttotal * 100.0;
-                              if (unreppctpft > newpctpft) {
-                                  unreppctpft = newpctpft;
-                              }
-                              outPCTPFTGrid[pftid][clmlin * MAXOUTPIX + clmpix] = newpctpft;
-                          }
-                          else {
-                              outPCTPFTGrid[pftid][clmlin * MAXOUTPIX + clmpix] = 0.0;
-                          }
-                      }
-                  }
-              }
-              else {
-                  outPCTNATVEGGrid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-                  outPCTPFTGrid[0][clmlin * MAXOUTPIX + clmpix] = 100.0;
-                  outUNREPPFTGrid[0][clmlin * MAXOUTPIX + clmpix] = 0.0;
-                  for (pftid = 0; pftid < MAXPFT; pftid++) {
-                      outPCTPFTGrid[pftid][clmlin * MAXOUTPIX + clmpix] = 0.0;
-                      outUNREPPFTGrid[pftid][clmlin * MAXOUTPIX + clmpix] = 0.0;
-                  }
-              }
-          }
+  context->kernelthreadids = (pthread_t *) malloc(kernelthreads * sizeof(pthread_t));
+  for (threadid = 1; threadid < kernelthreads; threadid++) {
+      if (pthread_create(&context->kernelthreadids[threadid], NULL, kernelthreadloop, context) != 0) {
+          fprintf(stderr,"Unable to start kernel thread\n");
+          exit(1);
       }
   }
 
   return 0;
-  
+
 }
 
+int finishkernelthreads(yearcontext *context) {
 
-int generateclmCFTGrids() {
+  int threadid;
 
-  long clmlin, clmpix;
-  int cftid, rawcftid, rainfedcftid, irrigcftid;
-  float pctcropval, c3annunrepval, c4annunrepval, c3perunrepval, c4perunrepval, c3nfxunrepval;
-  float newpctrainfedcft, newpctirrigcft, newunreprainfedval, newunrepirrigval;
-  float newpctcroptotal, newpctcft;
+  pthread_mutex_lock(&context->kernelmutex);
+  context->kerneljob = -1;
+  pthread_cond_broadcast(&context->kernelstartcond);
+  pthread_mutex_unlock(&context->kernelmutex);
 
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          if (inLANDMASKGrid[clmlin * MAXOUTPIX + clmpix] == 1) {
-              pctcropval = inCURRCROPTOTALGrid[clmlin * MAXOUTPIX + clmpix] * 100.0;
-              if (pctcropval > 0.0 && pctcropval <= 100.0) {
-                  outPCTCROPGrid[clmlin * MAXOUTPIX + clmpix] = pctcropval;
-                  c3annunrepval = inUNREPC3ANNGrid[clmlin * MAXOUTPIX + clmpix];
-                  c4annunrepval = inUNREPC4ANNGrid[clmlin * MAXOUTPIX + clmpix];
-                  c3perunrepval = inUNREPC3PERGrid[clmlin * MAXOUTPIX + clmpix];
-                  c4perunrepval = inUNREPC4PERGrid[clmlin * MAXOUTPIX + clmpix];
-                  c3nfxunrepval = inUNREPC3NFXGrid[clmlin * MAXOUTPIX + clmpix];
-                  for (rawcftid = 0; rawcftid < MAXCFTRAW; rawcftid++) {
-                      rainfedcftid = 2 * (rawcftid + 1);
-                      irrigcftid = 2 * (rawcftid + 1) + 1;
-                      newpctrainfedcft = inCURRC3ANNGrid[clmlin * MAXOUTPIX + clmpix] * (1.0 - inIRRIGC3ANNGrid[clmlin * MAXOUTPIX + clmpix]) * inC3ANNPCTCFTGrid[rawcftid][clmlin * MAXOUTPIX + clmpix];
-                      newpctirrigcft = inCURRC3ANNGrid[clmlin * MAXOUTPIX + clmpix] * (inIRRIGC3ANNGrid[clmlin * MAXOUTPIX + clmpix]) * inC3ANNPCTCFTGrid[rawcftid][clmlin * MAXOUTPIX + clmpix];
-                      newunreprainfedval = c3annunrepval * newpctrainfedcft / 100.0;
-                      newunrepirrigval = c3annunrepval * newpctirrigcft / 100.0;
-                      if (newpctrainfedcft > 0.0) {
-                          outPCTCFTGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] = outPCTCFTGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] + newpctrainfedcft;
-                          outUNREPCFTGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] = outUNREPCFTGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] + newunreprainfedval;
-                          outFERTNITROGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] = inFERTC3ANNGrid[clmlin * MAXOUTPIX + clmpix] / 10.0;
-                      }
-                      if (newpctirrigcft > 0.0) {
-                          outPCTCFTGrid[irrigcftid][clmlin * MAXOUTPIX + clmpix] = outPCTCFTGrid[irrigcftid][clmlin * MAXOUTPIX + clmpix] + newpctirrigcft;
-                          outUNREPCFTGrid[irrigcftid][clmlin * MAXOUTPIX + clmpix] = outUNREPCFTGrid[irrigcftid][clmlin * MAXOUTPIX + clmpix] + newunrepirrigval;
-                          outFERTNITROGrid[irrigcftid][clmlin * MAXOUTPIX + clmpix] = inFERTC3ANNGrid[clmlin * MAXOUTPIX + clmpix] / 10.0;
-                      }
-                      newpctrainfedcft = inCURRC4ANNGrid[clmlin * MAXOUTPIX + clmpix] * (1.0 - inIRRIGC4ANNGrid[clmlin * MAXOUTPIX + clmpix]) * inC4ANNPCTCFTGrid[rawcftid][clmlin * MAXOUTPIX + clmpix];
-                      newpctirrigcft = inCURRC4ANNGrid[clmlin * MAXOUTPIX + clmpix] * (inIRRIGC4ANNGrid[clmlin * MAXOUTPIX + clmpix]) * inC4ANNPCTCFTGrid[rawcftid][clmlin * MAXOUTPIX + clmpix];
-                      newunreprainfedval = c4annunrepval * newpctrainfedcft / 100.0;
-                      newunrepirrigval = c4annunrepval * newpctirrigcft / 100.0;
-                      if (newpctrainfedcft > 0.0) {
-                          outPCTCFTGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] = outPCTCFTGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] + newpctrainfedcft;
-                          outUNREPCFTGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] = outUNREPCFTGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] + newunreprainfedval;
-                          outFERTNITROGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] = inFERTC4ANNGrid[clmlin * MAXOUTPIX + clmpix] / 10.0;
-                      }
-                      if (newpctirrigcft > 0.0) {
-                          outPCTCFTGrid[irrigcftid][clmlin * MAXOUTPIX + clmpix] = outPCTCFTGrid[irrigcftid][clmlin * MAXOUTPIX + clmpix] + newpctirrigcft;
-                          outUNREPCFTGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] = outUNREPCFTGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] + newunrepirrigval;
-                          outFERTNITROGrid[irrigcftid][clmlin * MAXOUTPIX + clmpix] = inFERTC4ANNGrid[clmlin * MAXOUTPIX + clmpix] / 10.0;
-                      }
-                      newpctrainfedcft = inCURRC3PERGrid[clmlin * MAXOUTPIX + clmpix] * (1.0 - inIRRIGC3PERGrid[clmlin * MAXOUTPIX + clmpix]) * inC3PERPCTCFTGrid[rawcftid][clmlin * MAXOUTPIX + clmpix];
-                      newpctirrigcft = inCURRC3PERGrid[clmlin * MAXOUTPIX + clmpix] * (inIRRIGC3PERGrid[clmlin * MAXOUTPIX + clmpix]) * inC3PERPCTCFTGrid[rawcftid][clmlin * MAXOUTPIX + clmpix];
-                      newunreprainfedval = c3perunrepval * newpctrainfedcft / 100.0;
-                      newunrepirrigval = c3perunrepval * newpctirrigcft / 100.0;
-                      if (newpctrainfedcft > 0.0) {
-                          outPCTCFTGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] = outPCTCFTGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] + newpctrainfedcft;
-                          outUNREPCFTGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] = outUNREPCFTGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] + newunreprainfedval;
-                          outFERTNITROGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] = inFERTC3PERGrid[clmlin * MAXOUTPIX + clmpix] / 10.0;
-                      }
-                      if (newpctirrigcft > 0.0) {
-                          outPCTCFTGrid[irrigcftid][clmlin * MAXOUTPIX + clmpix] = outPCTCFTGrid[irrigcftid][clmlin * MAXOUTPIX + clmpix] + newpctirrigcft;
-                          outUNREPCFTGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] = outUNREPCFTGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] + newunrepirrigval;
-                          outFERTNITROGrid[irrigcftid][clmlin * MAXOUTPIX + clmpix] = inFERTC3PERGrid[clmlin * MAXOUTPIX + clmpix] / 10.0;
-                      }
-                      newpctrainfedcft = inCURRC4PERGrid[clmlin * MAXOUTPIX + clmpix] * (1.0 - inIRRIGC4PERGrid[clmlin * MAXOUTPIX + clmpix]) * inC4PERPCTCFTGrid[rawcftid][clmlin * MAXOUTPIX + clmpix];
-                      newpctirrigcft = inCURRC4PERGrid[clmlin * MAXOUTPIX + clmpix] * (inIRRIGC4PERGrid[clmlin * MAXOUTPIX + clmpix]) * inC4PERPCTCFTGrid[rawcftid][clmlin * MAXOUTPIX + clmpix];
-                      newunreprainfedval = c4perunrepval * newpctrainfedcft / 100.0;
-                      newunrepirrigval = c4perunrepval * newpctirrigcft / 100.0;
-                      if (newpctrainfedcft > 0.0) {
-                          outPCTCFTGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] = outPCTCFTGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] + newpctrainfedcft;
-                          outUNREPCFTGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] = outUNREPCFTGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] + newunreprainfedval;
-                          outFERTNITROGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] = inFERTC4PERGrid[clmlin * MAXOUTPIX + clmpix] / 10.0;
-                      }
-                      if (newpctirrigcft > 0.0) {
-                          outPCTCFTGrid[irrigcftid][clmlin * MAXOUTPIX + clmpix] = outPCTCFTGrid[irrigcftid][clmlin * MAXOUTPIX + clmpix] + newpctirrigcft;
-                          outUNREPCFTGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] = outUNREPCFTGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] + newunrepirrigval;
-                          outFERTNITROGrid[irrigcftid][clmlin * MAXOUTPIX + clmpix] = inFERTC4PERGrid[clmlin * MAXOUTPIX + clmpix] / 10.0;
-                      }
-                      newpctrainfedcft = inCURRC3NFXGrid[clmlin * MAXOUTPIX + clmpix] * (1.0 - inIRRIGC3NFXGrid[clmlin * MAXOUTPIX + clmpix]) * inC3NFXPCTCFTGrid[rawcftid][clmlin * MAXOUTPIX + clmpix];
-                      newpctirrigcft = inCURRC3NFXGrid[clmlin * MAXOUTPIX + clmpix] * (inIRRIGC3NFXGrid[clmlin * MAXOUTPIX + clmpix]) * inC3NFXPCTCFTGrid[rawcftid][clmlin * MAXOUTPIX + clmpix];
-                      newunreprainfedval = c3nfxunrepval * newpctrainfedcft / 100.0;
-                      newunrepirrigval = c3nfxunrepval * newpctirrigcft / 100.0;
-                      if (newpctrainfedcft > 0.0) {
-                          outPCTCFTGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] = outPCTCFTGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] + newpctrainfedcft;
-                          outUNREPCFTGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] = outUNREPCFTGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] + newunreprainfedval;
-                          outFERTNITROGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] = inFERTC3NFXGrid[clmlin * MAXOUTPIX + clmpix] / 10.0;
-                      }
-                      if (newpctirrigcft > 0.0) {
-                          outPCTCFTGrid[irrigcftid][clmlin * MAXOUTPIX + clmpix] = outPCTCFTGrid[irrigcftid][clmlin * MAXOUTPIX + clmpix] + newpctirrigcft;
-                          outUNREPCFTGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] = outUNREPCFTGrid[rainfedcftid][clmlin * MAXOUTPIX + clmpix] + newunrepirrigval;
-                          outFERTNITROGrid[irrigcftid][clmlin * MAXOUTPIX + clmpix] = inFERTC3NFXGrid[clmlin * MAXOUTPIX + clmpix] / 10.0;
-                      }
-                  }
-                  newpctcroptotal = 0.0;
-                  for (cftid = 0; cftid < MAXCFT; cftid++) {
-                      newpctcroptotal = newpctcroptotal + outPCTCFTGrid[cftid][clmlin * MAXOUTPIX + clmpix];
-                  }
-                  if (newpctcroptotal > 0.0) {
-                      for (cftid = 0; cftid < MAXCFT; cftid++) {
-                          newpctcft = outPCTCFTGrid[cftid][clmlin * MAXOUTPIX + clmpix];
-                          if (newpctcft > 0.0) {
-                              newpctcft = newpctcft / newpctcroptotal * 100.0;
-                              outPCTCFTGrid[cftid][clmlin * MAXOUTPIX + clmpix] = newpctcft;
-                          }
-                          else {
-                              outPCTCFTGrid[cftid][clmlin * MAXOUTPIX + clmpix] = 0.0;
-                          }
-                      }
-                  }
-              }
-              else {
-                  outPCTCROPGrid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-                  outPCTCFTGrid[0][clmlin * MAXOUTPIX + clmpix] = 100.0;
-                  outUNREPCFTGrid[0][clmlin * MAXOUTPIX + clmpix] = 0.0;
-                  for (cftid = 1; cftid < MAXCFT; cftid++) {
-                      outPCTCFTGrid[cftid][clmlin * MAXOUTPIX + clmpix] = 0.0;
-                      outUNREPCFTGrid[cftid][clmlin * MAXOUTPIX + clmpix] = 0.0;
-                  }
-              }
-          }
-      }
+  for (threadid = 1; threadid < kernelthreads; threadid++) {
+      pthread_join(context->kernelthreadids[threadid], NULL);
   }
+  free(context->kernelthreadids);
+  context->kerneljob = 0;
 
   return 0;
-  
+
 }
 
+void *yearworkerloop(void *arg) {
 
-int generateclmwoodharvestGrids() {
+  /* take the next year, compute it in this worker's context and hand it to the writer - years are taken in order so */
+  /* the reader and writer rings never wait on a year that has not been started */
 
-  long clmlin, clmpix;
-  int pftid;
-  float TreePFTArea, TreeFrac, TreeScale, PFTArea;
-  float newharvestvh1, newharvestvh2, newharvestsh1, newharvestsh2, newharvestsh3;
-  float newbiohvh1, newbiohvh2, newbiohsh1, newbiohsh2, newbiohsh3;
+  yearcontext *context;
+  phaseclock clock;
+  int yearnumber;
 
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          if (inLANDMASKGrid[clmlin * MAXOUTPIX + clmpix] == 1.0) {
-              TreePFTArea = 0.0;
-              TreeFrac = 0.0;
-              PFTArea = inAREAGrid[clmlin * MAXOUTPIX + clmpix] * inLANDFRACGrid[clmlin * MAXOUTPIX + clmpix] * outPCTNATVEGGrid[clmlin * MAXOUTPIX + clmpix] / 100.0 * 1.0e6;              
-              for (pftid = firsttreepft; pftid <= lasttreepft; pftid++) {
-                  TreePFTArea = TreePFTArea + PFTArea * outPCTPFTGrid[pftid][clmlin * MAXOUTPIX + clmpix] / 100.0;
-                  TreeFrac = TreeFrac + outPCTPFTGrid[pftid][clmlin * MAXOUTPIX + clmpix] / 100.0;
-              }
-              TreeScale = 1.0;
-              if (TreePFTArea > 1.0e6) {
-                   newharvestvh1 = inHARVESTVH1Grid[clmlin * MAXOUTPIX + clmpix] * TreeScale;
-                  if (newharvestvh1 < 0.0 || newharvestvh1 > 9.0e4) {
-                      newharvestvh1 = 0.0;
-                  }
-                  if (newharvestvh1 > 0.98) {
-                      newharvestvh1 = 0.98;
-                  }
-                  outHARVESTVH1Grid[clmlin * MAXOUTPIX + clmpix] = newharvestvh1;
-                   newbiohvh1 = inBIOHVH1Grid[clmlin * MAXOUTPIX + clmpix] * 1000.0 / TreePFTArea * TreeScale;
-                  if (newbiohvh1 < 0.0) {
-                      newbiohvh1 = 0.0;
-                  }
-                  if (newbiohvh1 > 10000.0) {
-                      newbiohvh1 = 10000.0;
-                  }
-                  outBIOHVH1Grid[clmlin * MAXOUTPIX + clmpix] = newbiohvh1;
-                   newharvestvh2 = inHARVESTVH2Grid[clmlin * MAXOUTPIX + clmpix] * TreeScale;
-                  if (newharvestvh2 < 0.0 || newharvestvh2 > 9.0e4) {
-                      newharvestvh2 = 0.0;
-                  }
-                  if (newharvestvh2 > 0.98) {
-                      newharvestvh2 = 0.98;
-                  }
-                  outHARVESTVH2Grid[clmlin * MAXOUTPIX + clmpix] = newharvestvh2;
-                  newbiohvh2 = inBIOHVH2Grid[clmlin * MAXOUTPIX + clmpix] * 1000.0 / TreePFTArea * TreeScale;
-                  if (newbiohvh2 < 0.0) {
-                      newbiohvh2 = 0.0;
-                  }
-                  if (newbiohvh2 > 10000.0) {
-                      newbiohvh2 = 10000.0;
-                  }
-                  outBIOHVH2Grid[clmlin * MAXOUTPIX + clmpix] = newbiohvh2;
-                   newharvestsh1 = inHARVESTSH1Grid[clmlin * MAXOUTPIX + clmpix] * TreeScale;
-                  if (newharvestsh1 < 0.0 || newharvestsh1 > 9.0e4) {
-                      newharvestsh1 = 0.0;
-                  }
-                  if (newharvestsh1 > 0.98) {
-                      newharvestsh1 = 0.98;
-                  }
-                  outHARVESTSH1Grid[clmlin * MAXOUTPIX + clmpix] = newharvestsh1;
-                  newbiohsh1 = inBIOHSH1Grid[clmlin * MAXOUTPIX + clmpix] * 1000.0 / TreePFTArea * TreeScale;
-                  if (newbiohsh1 < 0.0) {
-                      newbiohsh1 = 0.0;
-                  }
-                  if (newbiohsh1 > 10000.0) {
-                      newbiohsh1 = 10000.0;
-                  }
-                  outBIOHSH1Grid[clmlin * MAXOUTPIX + clmpix] = newbiohsh1;
-                   newharvestsh2 = inHARVESTSH2Grid[clmlin * MAXOUTPIX + clmpix] * TreeScale;
-                  if (newharvestsh2 < 0.0 || newharvestsh2 > 9.0e4) {
-                      newharvestsh2 = 0.0;
-                  }
-                  if (newharvestsh2 > 0.98) {
-                      newharvestsh2 = 0.98;
-                  }
-                  outHARVESTSH2Grid[clmlin * MAXOUTPIX + clmpix] = newharvestsh2;
-                  newbiohsh2 = inBIOHSH2Grid[clmlin * MAXOUTPIX + clmpix] * 1000.0 / TreePFTArea * TreeScale;
-                  if (newbiohsh2 < 0.0) {
-                      newbiohsh2 = 0.0;
-                  }
-                  if (newbiohsh2 > 10000.0) {
-                      newbiohsh2 = 10000.0;
-                  }
-                  outBIOHSH2Grid[clmlin * MAXOUTPIX + clmpix] = newbiohsh2;
-                   newharvestsh3 = inHARVESTSH3Grid[clmlin * MAXOUTPIX + clmpix] * TreeScale;
-                  if (newharvestsh3 < 0.0 || newharvestsh3 > 9.0e4) {
-                      newharvestsh3 = 0.0;
-                  }
-                  if (newharvestsh3 > 0.98) {
-                      newharvestsh3 = 0.98;
-                  }
-                  outHARVESTSH3Grid[clmlin * MAXOUTPIX + clmpix] = newharvestsh3;
-                  newbiohsh3 = inBIOHSH3Grid[clmlin * MAXOUTPIX + clmpix] * 1000.0 / TreePFTArea * TreeScale;
-                  if (newbiohsh3 < 0.0) {
-                      newbiohsh3 = 0.0;
-                  }
-                  if (newbiohsh3 > 10000.0) {
-                      newbiohsh3 = 10000.0;
-                  }
-                  outBIOHSH3Grid[clmlin * MAXOUTPIX + clmpix] = newbiohsh3;
-              }
-          }
+  context = (yearcontext *) arg;
+  createkernelscratch();
+
+  while (1) {
+      pthread_mutex_lock(&yearworkermutex);
+      yearnumber = nextworkeryear;
+      nextworkeryear++;
+      pthread_mutex_unlock(&yearworkermutex);
+
+      if (yearnumber > endyear) {
+          break;
+      }
+      if (acquireoutputgridset(yearnumber) != 0) {
+          break;
       }
+      acquireinputgridset(yearnumber);
+
+      startphase(&clock);
+      generateyearGrids(context,yearnumber);
+      endphase(&clock,PHASE_GENERATE,yearnumber,landpixcount,1);
+
+      releaseinputgridset(yearnumber);
+      queueoutputgridset(yearnumber);
   }
 
-  return 0;
-  
+  freekernelscratch();
+
+  return NULL;
+
 }
 
-int generatedblGrids() {
+int startyearworkers() {
 
-  double AllFrac, OtherFrac, AllPFTs, AllCFTs, tempdblPCT;
-  long clmlin, clmpix;
-  int pftid, cftid;
-  
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          outAREAdblGrid[clmlin * MAXOUTPIX + clmpix] = inAREAGrid[clmlin * MAXOUTPIX + clmpix];
-          if (inLANDMASKGrid[clmlin * MAXOUTPIX + clmpix] == 1.0) {
-              outLANDFRACdblGrid[clmlin * MAXOUTPIX + clmpix] = inLANDFRACGrid[clmlin * MAXOUTPIX + clmpix];
-              outPCTGLACIERdblGrid[clmlin * MAXOUTPIX + clmpix] = inPCTGLACIERGrid[clmlin * MAXOUTPIX + clmpix];
-              outPCTLAKEdblGrid[clmlin * MAXOUTPIX + clmpix] = inPCTLAKEGrid[clmlin * MAXOUTPIX + clmpix];
-              outPCTWETLANDdblGrid[clmlin * MAXOUTPIX + clmpix] = inPCTWETLANDGrid[clmlin * MAXOUTPIX + clmpix];
-              outPCTURBANdblGrid[clmlin * MAXOUTPIX + clmpix] = inPCTURBANGrid[clmlin * MAXOUTPIX + clmpix];
-              outPCTCROPdblGrid[clmlin * MAXOUTPIX + clmpix] = outPCTCROPGrid[clmlin * MAXOUTPIX + clmpix];
-              outPCTNATVEGdblGrid[clmlin * MAXOUTPIX + clmpix] = outPCTNATVEGGrid[clmlin * MAXOUTPIX + clmpix];	      
-              OtherFrac = outPCTGLACIERdblGrid[clmlin * MAXOUTPIX + clmpix] + outPCTLAKEdblGrid[clmlin * MAXOUTPIX + clmpix] + outPCTWETLANDdblGrid[clmlin * MAXOUTPIX + clmpix] + outPCTURBANdblGrid[clmlin * MAXOUTPIX + clmpix];
-              AllFrac = outPCTCROPdblGrid[clmlin * MAXOUTPIX + clmpix] + outPCTNATVEGdblGrid[clmlin * MAXOUTPIX + clmpix];
-              AllPFTs = 0.0;
-              for (pftid = 0; pftid < MAXPFT; pftid++) {
-                  AllPFTs = AllPFTs + outPCTPFTGrid[pftid][clmlin * MAXOUTPIX + clmpix];
-              }
-              AllCFTs = 0.0;
-              for (cftid = 0; cftid < MAXCFT; cftid++) {
-                  AllCFTs = AllCFTs + outPCTCFTGrid[cftid][clmlin * MAXOUTPIX + clmpix];
-              }
-              if (AllFrac == 0.0) {
-                  outPCTNATVEGdblGrid[clmlin * MAXOUTPIX + clmpix] = 100.0;
-                  outPCTCROPdblGrid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-                  outPCTPFTdblGrid[0][clmlin * MAXOUTPIX + clmpix] = 100.0;
-                  for (pftid = 1; pftid < MAXPFT; pftid++) {
-                      outPCTPFTdblGrid[pftid][clmlin * MAXOUTPIX + clmpix] = 0.0;
-                  }
-                  outPCTCFTdblGrid[0][clmlin * MAXOUTPIX + clmpix] = 100.0;
-                  for (cftid = 1; cftid < MAXCFT; cftid++) {
-                      outPCTCFTdblGrid[cftid][clmlin * MAXOUTPIX + clmpix] = 0.0;
-                  }
-                  for (cftid = 0; cftid < MAXCFT; cftid++) {
-                      outFERTNITROdblGrid[cftid][clmlin * MAXOUTPIX + clmpix] = 0.0;
-                  }
-                  for (pftid = 0; pftid < MAXPFT; pftid++) {
-                      outUNREPPFTdblGrid[pftid][clmlin * MAXOUTPIX + clmpix] = 0.0;
-                  }
-                  for (cftid = 0; cftid < MAXCFT; cftid++) {
-                      outUNREPCFTdblGrid[cftid][clmlin * MAXOUTPIX + clmpix] = 0.0;
-                  }
-                  outBIOHVH1dblGrid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-                  outBIOHVH2dblGrid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-                  outBIOHSH1dblGrid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-                  outBIOHSH2dblGrid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-                  outBIOHSH3dblGrid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-              }
-              else {
-                  outPCTCROPdblGrid[clmlin * MAXOUTPIX + clmpix] = outPCTCROPGrid[clmlin * MAXOUTPIX + clmpix];
-                  outPCTNATVEGdblGrid[clmlin * MAXOUTPIX + clmpix] = 100.0 - outPCTCROPdblGrid[clmlin * MAXOUTPIX + clmpix];
-                  if (AllPFTs == 0.0) {
-                      outPCTPFTdblGrid[0][clmlin * MAXOUTPIX + clmpix] = 100.0;
-                      for (pftid = 1; pftid < MAXPFT; pftid++) {
-                          outPCTPFTdblGrid[pftid][clmlin * MAXOUTPIX + clmpix] = 0.0;
-                      }
-                  }
-                  else {
-                      for (pftid = 0; pftid < MAXPFT; pftid++) {
-                          tempdblPCT = outPCTPFTGrid[pftid][clmlin * MAXOUTPIX + clmpix];
-                          outPCTPFTdblGrid[pftid][clmlin * MAXOUTPIX + clmpix] = tempdblPCT * 100.0 / AllPFTs;
-                      }
-                  }
-                  if (AllCFTs == 0.0) {
-                      outPCTCFTdblGrid[0][clmlin * MAXOUTPIX + clmpix] = 100.0;
-                      for (cftid = 1; cftid < MAXCFT; cftid++) {
-                          outPCTCFTdblGrid[cftid][clmlin * MAXOUTPIX + clmpix] = 0.0;
-                      }
-                  }
-                  else {
-                      for (cftid = 0; cftid < MAXCFT; cftid++) {
-                          tempdblPCT = outPCTCFTGrid[cftid][clmlin * MAXOUTPIX + clmpix];
-                          outPCTCFTdblGrid[cftid][clmlin * MAXOUTPIX + clmpix] = tempdblPCT * 100.0 / AllCFTs;
-                      }
-                  }
-                  for (cftid = 0; cftid < MAXCFT; cftid++) {
-                      outFERTNITROdblGrid[cftid][clmlin * MAXOUTPIX + clmpix] = outFERTNITROGrid[cftid][clmlin * MAXOUTPIX + clmpix];
-                  }
-                  for (pftid = 0; pftid < MAXPFT; pftid++) {
-                      outUNREPPFTdblGrid[pftid][clmlin * MAXOUTPIX + clmpix] = outUNREPPFTGrid[pftid][clmlin * MAXOUTPIX + clmpix];
-                  }
-                  for (cftid = 0; cftid < MAXCFT; cftid++) {
-                      outUNREPCFTdblGrid[cftid][clmlin * MAXOUTPIX + clmpix] = outUNREPCFTGrid[cftid][clmlin * MAXOUTPIX + clmpix];
-                  }
-                  outBIOHVH1dblGrid[clmlin * MAXOUTPIX + clmpix] = outBIOHVH1Grid[clmlin * MAXOUTPIX + clmpix];
-                  outBIOHVH2dblGrid[clmlin * MAXOUTPIX + clmpix] = outBIOHVH2Grid[clmlin * MAXOUTPIX + clmpix];
-                  outBIOHSH1dblGrid[clmlin * MAXOUTPIX + clmpix] = outBIOHSH1Grid[clmlin * MAXOUTPIX + clmpix];
-                  outBIOHSH2dblGrid[clmlin * MAXOUTPIX + clmpix] = outBIOHSH2Grid[clmlin * MAXOUTPIX + clmpix];
-                  outBIOHSH3dblGrid[clmlin * MAXOUTPIX + clmpix] = outBIOHSH3Grid[clmlin * MAXOUTPIX + clmpix];
-              }        
-          } 
-          else {
-              outLANDFRACdblGrid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-              outPCTGLACIERdblGrid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-              outPCTLAKEdblGrid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-              outPCTWETLANDdblGrid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-              outPCTURBANdblGrid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-              outPCTCROPdblGrid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-              outPCTNATVEGdblGrid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-              for (pftid = 0; pftid < MAXPFT; pftid++) {
-                  outPCTPFTdblGrid[pftid][clmlin * MAXOUTPIX + clmpix] = 0.0;
-              }
-              for (cftid = 0; cftid < MAXCFT; cftid++) {
-                  outPCTCFTdblGrid[cftid][clmlin * MAXOUTPIX + clmpix] = 0.0;
-              }
-              for (cftid = 0; cftid < MAXCFT; cftid++) {
-                  outFERTNITROdblGrid[cftid][clmlin * MAXOUTPIX + clmpix] = 0.0;
-              }
-              for (pftid = 0; pftid < MAXPFT; pftid++) {
-                  outUNREPPFTdblGrid[pftid][clmlin * MAXOUTPIX + clmpix] = 0.0;
-              }
-              for (cftid = 0; cftid < MAXCFT; cftid++) {
-                  outUNREPCFTdblGrid[cftid][clmlin * MAXOUTPIX + clmpix] = 0.0;
-              }
-              outBIOHVH1dblGrid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-              outBIOHVH2dblGrid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-              outBIOHSH1dblGrid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-              outBIOHSH2dblGrid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-              outBIOHSH3dblGrid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-          }
+  int threadid;
+
+  nextworkeryear = startyear;
+  yearworkerthreads = (pthread_t *) malloc(yearthreads * sizeof(pthread_t));
+  for (threadid = 0; threadid < yearthreads; threadid++) {
+      startkernelthreads(&yearcontexts[threadid]);
+      if (pthread_create(&yearworkerthreads[threadid], NULL, yearworkerloop, &yearcontexts[threadid]) != 0) {
+          fprintf(stderr,"Unable to start year worker thread\n");
+          exit(1);
       }
   }
-  
+
   return 0;
 
 }
 
-int swapoceanGrids() {
+int finishyearworkers() {
 
-  double scalelandunits;
-  long clmlin, clmpix;
-  int pftid, cftid;
-  
-  for (clmlin = 0; clmlin < MAXOUTLIN; clmlin++) {
-      for (clmpix = 0; clmpix < MAXOUTPIX; clmpix++) {
-          if (inLANDMASKGrid[clmlin * MAXOUTPIX + clmpix] == 0.0) {
-              inLANDMASKGrid[clmlin * MAXOUTPIX + clmpix] = 1.0;
-	      outLANDFRACdblGrid[clmlin * MAXOUTPIX + clmpix] = 1.0;
-	      outPCTLAKEdblGrid[clmlin * MAXOUTPIX + clmpix] = 100.0;
-	      outPCTCROPdblGrid[clmlin * MAXOUTPIX + clmpix] = 0.0;
-              outPCTPFTdblGrid[0][clmlin * MAXOUTPIX + clmpix] = 100.0;
-              for (pftid = 1; pftid < MAXPFT; pftid++) {
-                  outPCTPFTdblGrid[pftid][clmlin * MAXOUTPIX + clmpix] = 0.0;
-              }
-              outPCTCFTdblGrid[0][clmlin * MAXOUTPIX + clmpix] = 100.0;
-              for (cftid = 1; cftid < MAXCFT; cftid++) {
-                  outPCTCFTdblGrid[cftid][clmlin * MAXOUTPIX + clmpix] = 0.0;
-              }
-              for (cftid = 0; cftid < MAXCFT; cftid++) {
-                  outFERTNITROdblGrid[cftid][clmlin * MAXOUTPIX + clmpix] = 0.0;
-              }	      
-	  }
-	  else {
-	      scalelandunits = outLANDFRACdblGrid[clmlin * MAXOUTPIX + clmpix];
-	      outLANDFRACdblGrid[clmlin * MAXOUTPIX + clmpix] = 1.0;
-	      outPCTGLACIERdblGrid[clmlin * MAXOUTPIX + clmpix] = scalelandunits * outPCTGLACIERdblGrid[clmlin * MAXOUTPIX + clmpix];
-	      outPCTLAKEdblGrid[clmlin * MAXOUTPIX + clmpix] = scalelandunits * outPCTLAKEdblGrid[clmlin * MAXOUTPIX + clmpix] + (1.0 - scalelandunits) * 100.0;
-	      outPCTWETLANDdblGrid[clmlin * MAXOUTPIX + clmpix] = scalelandunits * outPCTWETLANDdblGrid[clmlin * MAXOUTPIX + clmpix];
-	      outPCTURBANdblGrid[clmlin * MAXOUTPIX + clmpix] = scalelandunits * outPCTURBANdblGrid[clmlin * MAXOUTPIX + clmpix];
-	      outPCTCROPdblGrid[clmlin * MAXOUTPIX + clmpix] = scalelandunits * outPCTCROPdblGrid[clmlin * MAXOUTPIX + clmpix];
-	      outPCTNATVEGdblGrid[clmlin * MAXOUTPIX + clmpix] = scalelandunits * outPCTNATVEGdblGrid[clmlin * MAXOUTPIX + clmpix];
-	 }
-      }
+  int threadid;
+
+  for (threadid = 0; threadid < yearthreads; threadid++) {
+      pthread_join(yearworkerthreads[threadid], NULL);
+      finishkernelthreads(&yearcontexts[threadid]);
   }
-	      
+  free(yearworkerthreads);
+
   return 0;
-  
+
 }
 
 
-int writegrids(int currentyear) {
+int generatetile(int tileid) {
 
-  char outncfilename[1024];
-  long clmlin, clmpix;
-  int pftid, cftid;
-  char pftidstr[256];
-  char cftidstr[256];
-
-  sprintf(outncfilename,"%s/%s_%d.nc",outputdir,outputseries,currentyear);
-  createncoutputfile(outncfilename);
-  openncoutputfile(outncfilename);
-  
-  writenc1dintfield("natpft",innatpft);
-  writenc1dintfield("cft",incft);
-  writenc0dfield("EDGEN",&inEDGEN);
-  writenc0dfield("EDGEE",&inEDGEE);
-  writenc0dfield("EDGES",&inEDGES);
-  writenc0dfield("EDGEW",&inEDGEW);
-  writenc1dfield("LAT",inLAT);
-  writenc2dfield("LATIXY",inLATIXY);
-  writenc1dfield("LON",inLON);
-  writenc2dfield("LONGXY",inLONGXY);
-  writenc2dfield("LANDMASK",inLANDMASKGrid);
-  writenc2ddblfield("LANDFRAC",outLANDFRACdblGrid);
-  writenc2ddblfield("AREA",outAREAdblGrid);
-  writenc2ddblfield("PCT_GLACIER",outPCTGLACIERdblGrid);
-  writenc2ddblfield("PCT_LAKE",outPCTLAKEdblGrid);
-  writenc2ddblfield("PCT_WETLAND",outPCTWETLANDdblGrid);
-  writenc2ddblfield("PCT_URBAN",outPCTURBANdblGrid);
-  writenc2ddblfield("PCT_NATVEG",outPCTNATVEGdblGrid);
-  writenc2ddblfield("PCT_CROP",outPCTCROPdblGrid);
-  
-  for (pftid = 0; pftid < MAXPFT; pftid++) {
-      writenc3ddblfield("PCT_NAT_PFT",pftid,outPCTPFTdblGrid[pftid]);
-  }
-  
-  for (cftid = 0; cftid < MAXCFT; cftid++) {
-      writenc3ddblfield("PCT_CFT",cftid,outPCTCFTdblGrid[cftid]);
-  }
+  /* every year of one tile - the reference and base state grids are read for the tile's rows and the LUH years */
+  /* stream through the reader, year workers and writer as for a whole region */
 
-  for (cftid = 0; cftid < MAXCFT; cftid++) {
-      writenc3ddblfield("FERTNITRO_CFT",cftid,outFERTNITROdblGrid[cftid]);
+  phaseclock clock;
+
+  settileoptions(tileid);
+
+  startphase(&clock);
+  if (mapreferencecache() != 0) {
+      createreferencegrids();
+      readclmcurrentGrids();
+      readclmLUHforestGrids();
+      readclmLUHpastureGrids();
+      readclmLUHotherGrids();
+      readclmLUHc3annGrids();
+      readclmLUHc4annGrids();
+      readclmLUHc3perGrids();
+      readclmLUHc4perGrids();
+      readclmLUHc3nfxGrids();
+      writereferencecache();
   }
+  endphase(&clock,PHASE_REFERENCE,PHASEYEAR_TILE,MAXOUTPIX * MAXOUTLIN,1);
 
-  for (pftid = 0; pftid < MAXPFT; pftid++) {
-      writenc3ddblfield("UNREPRESENTED_PFT_LULCC",pftid,outUNREPPFTdblGrid[pftid]);
+  createlandindex();
+  startphase(&clock);
+  readLUHbasestateGrids();
+  endphase(&clock,PHASE_BASESTATES,PHASEYEAR_TILE,MAXOUTPIX * MAXOUTLIN,1);
+
+  if (outputtimeseries > 0) {
+      openncoutputseries();
   }
-  
-  for (cftid = 0; cftid < MAXCFT; cftid++) {
-      writenc3ddblfield("UNREPRESENTED_CFT_LULCC",cftid,outUNREPCFTdblGrid[cftid]);
+
+  startinputreader();
+  startoutputwriter();
+  startyearworkers();
+
+  finishyearworkers();
+  finishoutputwriter();
+  finishinputreader();
+
+  if (outputtimeseries > 0) {
+      closencoutputfile();
   }
 
-  writenc2ddblfield("HARVEST_VH1",outBIOHVH1dblGrid);
-  writenc2ddblfield("HARVEST_VH2",outBIOHVH2dblGrid);
-  writenc2ddblfield("HARVEST_SH1",outBIOHSH1dblGrid);
-  writenc2ddblfield("HARVEST_SH2",outBIOHSH2dblGrid);
-  writenc2ddblfield("HARVEST_SH3",outBIOHSH3dblGrid);
+  releasereferencegrids();
 
-  closencfile();
-  
   return 0;
 
 }
 
-
 main(long narg, char **argv) {
 
-  int yearnumber;
-    
+  int tileid;
+  struct rusage runusage;
+
+#ifdef USEMPI
+  int mpithreadlevel;
+
+  /* netCDF calls from the reader and writer threads are serialized by ncaccessmutex */
+  MPI_Init_thread(NULL, NULL, MPI_THREAD_SERIALIZED, &mpithreadlevel);
+  if (mpithreadlevel < MPI_THREAD_SERIALIZED) {
+      printf("MPI library does not support MPI_THREAD_SERIALIZED\n");
+      MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+#endif
+
   if(narg != 2){
         printf("Usage clm5landdatatool namelistfile\n");
         return 0;
   }
-  
+
   readnamelist(argv[1]);
   setregionoptions();
+  setbandoptions();
   readpftparamfile();
   readcftrawparamfile();
   readcftparamfile();
 
+  /* the first tile is the largest so every working grid is sized once for it and reused by later tiles */
+
+  settileoptions(0);
   createallgrids();
+  createphasetimings();
 
-  readclmcurrentGrids();
-  readclmLUHforestGrids();
-  readclmLUHpastureGrids();
-  readclmLUHotherGrids();
-  readclmLUHc3annGrids();
-  readclmLUHc4annGrids();
-  readclmLUHc3perGrids();
-  readclmLUHc4perGrids();
-  readclmLUHc3nfxGrids();
+  for (tileid = 0; tileid < tilecount; tileid++) {
+      generatetile(tileid);
+  }
 
-  readLUHbasestateGrids();
-  
-  for (yearnumber = startyear; yearnumber <= endyear; yearnumber++) {
-  
-      initializeGrids();
-      
-      readLUHcurrstateGrids(yearnumber);
-      readLUHprevstateGrids(yearnumber-1);
-  
-      readLUHwoodharvestGrids(yearnumber-1);
-  
-/*      readUNREPSECDFGrids(yearnumber-1);
-      readUNREPSECDNGrids(yearnumber-1);
-      readUNREPPASTRGrids(yearnumber-1);
-      readUNREPRANGEGrids(yearnumber-1);
-      readUNREPC3ANNGrids(yearnumber-1);
-      readUNREPC4ANNGrids(yearnumber-1);
-      readUNREPC3PERGrids(yearnumber-1);
-      readUNREPC4PERGrids(yearnumber-1);
-      readUNREPC3NFXGrids(yearnumber-1); */
-
-      readLUHcropmanagementGrids(yearnumber);
-
-      generateLUHcollectionGrids();
-      generateclmPFTGrids();
-      generateclmCFTGrids();
-      generateclmwoodharvestGrids();
-      generatedblGrids();
-      
-      if (includeOcean == 0) {
-          swapoceanGrids();
-      }
-      
-      writegrids(yearnumber);
+  closencinputpool();
+  writephasetimings();
+
+  /* the planned grids are printed by createallgrids before the first tile, this is what the run really touched */
+
+  getrusage(RUSAGE_SELF, &runusage);
+  printf("Peak RSS %ld MB\n",runusage.ru_maxrss / 1024);
+
+#ifdef USEMPI
+  /* mpirun treats a non zero exit status as a failed rank */
+  MPI_Finalize();
+  return 0;
+#endif
 
-  }
-  
   return 1;
-  
+
 }
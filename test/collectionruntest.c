@@ -0,0 +1,246 @@
+/* Check that the run based LUH collection kernels give bitwise the same grids as the original per pixel loop */
+/* Builds the tool with its main renamed and drives generateLUHcollectionGrids on a synthetic region with ocean */
+/* gaps and row ends that break the runs, states below 0 and above 1 and pixels with no natural vegetation */
+
+#define main clm5landusedatatool_main
+#include "../src/clm5landusedatatool.c"
+#undef main
+
+#define TESTLIN 23
+#define TESTPIX 97
+#define TESTSIZE (TESTLIN * TESTPIX)
+#define TESTGRIDS 14
+
+unsigned long testseed = 12345;
+
+float testvalue() {
+
+  /* a small linear congruential generator so every platform sees the same inputs - about one value in five */
+  /* is an edge value, the rest spread over -0.5 to 1.5 so the missing, forest and other clamps are all taken */
+
+  unsigned long draw;
+
+  testseed = testseed * 6364136223846793005UL + 1442695040888963407UL;
+  draw = (testseed >> 33) % 1000;
+
+  if (draw < 50) {
+      return 0.0;
+  }
+  if (draw < 100) {
+      return 1.0;
+  }
+  if (draw < 150) {
+      return -0.25;
+  }
+  if (draw < 200) {
+      return 1.75;
+  }
+
+  return (float) ((long) (testseed >> 40) % 100000) / 50000.0 - 0.5;
+
+}
+
+int createtestgrid(float **grid) {
+
+  long clmindex;
+
+  *grid = (float *) malloc(TESTSIZE * sizeof(float));
+  for (clmindex = 0; clmindex < TESTSIZE; clmindex++) {
+      (*grid)[clmindex] = testvalue();
+  }
+
+  return 0;
+
+}
+
+int createtestland() {
+
+  /* land in row order with ocean gaps of several widths, one all ocean row and land running up to the row ends */
+
+  long clmlin, clmpix, clmindex;
+
+  landpixindex = (long *) malloc(TESTSIZE * sizeof(long));
+  landpixcount = 0;
+  for (clmlin = 0; clmlin < TESTLIN; clmlin++) {
+      for (clmpix = 0; clmpix < TESTPIX; clmpix++) {
+          clmindex = clmlin * TESTPIX + clmpix;
+          if (clmlin == 7 || (clmpix % 11 == 5) || (clmpix >= 40 && clmpix < 40 + clmlin % 4) || ((clmindex * 7919) % 13 == 0)) {
+              continue;
+          }
+          landpixindex[landpixcount++] = clmindex;
+      }
+  }
+
+  return 0;
+
+}
+
+int createtestinputs() {
+
+  /* the base and current states, the secondary transitions and harvests - every tenth land pixel is all crop */
+  /* so it has no natural vegetation in either state */
+
+  float **statesgrids[] = {
+      &inBASEPRIMFGrid, &inBASEPRIMNGrid, &inBASESECDFGrid, &inBASESECDNGrid, &inBASEPASTRGrid, &inBASERANGEGrid,
+      &inBASEC3ANNGrid, &inBASEC4ANNGrid, &inBASEC3PERGrid, &inBASEC4PERGrid, &inBASEC3NFXGrid,
+      &inCURRPRIMFGrid, &inCURRPRIMNGrid, &inCURRSECDFGrid, &inCURRSECDNGrid, &inCURRPASTRGrid, &inCURRRANGEGrid,
+      &inCURRC3ANNGrid, &inCURRC4ANNGrid, &inCURRC3PERGrid, &inCURRC4PERGrid, &inCURRC3NFXGrid};
+  float **natveggrids[] = {
+      &inBASEPRIMFGrid, &inBASEPRIMNGrid, &inBASESECDFGrid, &inBASESECDNGrid, &inBASEPASTRGrid, &inBASERANGEGrid,
+      &inCURRPRIMFGrid, &inCURRPRIMNGrid, &inCURRSECDFGrid, &inCURRSECDNGrid, &inCURRPASTRGrid, &inCURRRANGEGrid};
+  int gridid;
+  long landid;
+
+  for (gridid = 0; gridid < (int) (sizeof(statesgrids) / sizeof(float **)); gridid++) {
+      createtestgrid(statesgrids[gridid]);
+  }
+  createtestgrid(&inUNREPSECDFGrid);
+  createtestgrid(&inUNREPSECDNGrid);
+  createtestgrid(&inHARVESTSH1Grid);
+  createtestgrid(&inHARVESTSH2Grid);
+  createtestgrid(&inHARVESTSH3Grid);
+
+  for (landid = 0; landid < landpixcount; landid += 10) {
+      for (gridid = 0; gridid < (int) (sizeof(natveggrids) / sizeof(float **)); gridid++) {
+          (*natveggrids[gridid])[landpixindex[landid]] = 0.0;
+      }
+      inBASEC3ANNGrid[landpixindex[landid]] = 1.0;
+      inCURRC3ANNGrid[landpixindex[landid]] = 1.0;
+  }
+
+  return 0;
+
+}
+
+int generatescalarcollection(float **scalargrids) {
+
+  /* the original one pixel at a time loop, writing into whole land length grids */
+
+  long landid, clmindex;
+  float *baseforesttotal = scalargrids[0], *basenonforesttotal = scalargrids[1], *basecroptotal = scalargrids[2];
+  float *basemissing = scalargrids[3], *baseother = scalargrids[4], *basenatveg = scalargrids[5];
+  float *currforesttotal = scalargrids[6], *currnonforesttotal = scalargrids[7], *currcroptotal = scalargrids[8];
+  float *currmissing = scalargrids[9], *currother = scalargrids[10], *currnatveg = scalargrids[11];
+  float *unrepforest = scalargrids[12], *unrepother = scalargrids[13];
+
+  for (landid = 0; landid < landpixcount; landid++) {
+      clmindex = landpixindex[landid];
+
+      baseforesttotal[landid] = inBASEPRIMFGrid[clmindex] + inBASESECDFGrid[clmindex];
+      basenonforesttotal[landid] = inBASEPRIMNGrid[clmindex] + inBASESECDNGrid[clmindex];
+      basecroptotal[landid] = inBASEC3ANNGrid[clmindex] + inBASEC4ANNGrid[clmindex] + inBASEC3PERGrid[clmindex] + inBASEC4PERGrid[clmindex] + inBASEC3NFXGrid[clmindex];
+      basemissing[landid] = 1.0 - baseforesttotal[landid] - basenonforesttotal[landid] - inBASEPASTRGrid[clmindex] - inBASERANGEGrid[clmindex] - basecroptotal[landid];
+      if (basemissing[landid] < 0.0) {
+          basemissing[landid] = 0.0;
+      }
+      if (basemissing[landid] > 1.0) {
+          basemissing[landid] = 1.0;
+      }
+      baseother[landid] = inBASEPRIMNGrid[clmindex] + inBASESECDNGrid[clmindex] + inBASERANGEGrid[clmindex] + basemissing[landid];
+      basenatveg[landid] = baseforesttotal[landid] + inBASEPASTRGrid[clmindex] + baseother[landid];
+
+      currforesttotal[landid] = inCURRPRIMFGrid[clmindex] + inCURRSECDFGrid[clmindex];
+      currnonforesttotal[landid] = inCURRPRIMNGrid[clmindex] + inCURRSECDNGrid[clmindex];
+      currcroptotal[landid] = inCURRC3ANNGrid[clmindex] + inCURRC4ANNGrid[clmindex] + inCURRC3PERGrid[clmindex] + inCURRC4PERGrid[clmindex] + inCURRC3NFXGrid[clmindex];
+      currmissing[landid] = 1.0 - currforesttotal[landid] - currnonforesttotal[landid] - inCURRPASTRGrid[clmindex] - inCURRRANGEGrid[clmindex] - currcroptotal[landid];
+      if (currmissing[landid] < 0.0) {
+          currmissing[landid] = 0.0;
+      }
+      if (currmissing[landid] > 1.0) {
+          currmissing[landid] = 1.0;
+      }
+      currother[landid] = inCURRPRIMNGrid[clmindex] + inCURRSECDNGrid[clmindex] + inCURRRANGEGrid[clmindex] + currmissing[landid];
+      currnatveg[landid] = currforesttotal[landid] + inCURRPASTRGrid[clmindex] + currother[landid];
+
+      unrepforest[landid] = inUNREPSECDFGrid[clmindex] - inHARVESTSH1Grid[clmindex] - inHARVESTSH2Grid[clmindex];
+      if (unrepforest[landid] < 0.0) {
+          unrepforest[landid] = 0.0;
+      }
+      if (unrepforest[landid] > 1.0) {
+          unrepforest[landid] = 1.0;
+      }
+      unrepother[landid] = inUNREPSECDNGrid[clmindex] - inHARVESTSH3Grid[clmindex];
+      if (unrepother[landid] < 0.0) {
+          unrepother[landid] = 0.0;
+      }
+      if (unrepother[landid] > 1.0) {
+          unrepother[landid] = 1.0;
+      }
+  }
+
+  return 0;
+
+}
+
+int generaterunscollection(float **rungrids, long blocksize) {
+
+  /* the run based kernels one block of the land index at a time like generatelandrange, copying each block's */
+  /* kernel scratch out to whole land length grids - an odd block size also breaks runs at the block ends */
+
+  float **scratchgrids[TESTGRIDS] = {
+      &inBASEFORESTTOTALGrid, &inBASENONFORESTTOTALGrid, &inBASECROPTOTALGrid, &inBASEMISSINGGrid, &inBASEOTHERGrid, &inBASENATVEGGrid,
+      &inCURRFORESTTOTALGrid, &inCURRNONFORESTTOTALGrid, &inCURRCROPTOTALGrid, &inCURRMISSINGGrid, &inCURROTHERGrid, &inCURRNATVEGGrid,
+      &inUNREPFORESTGrid, &inUNREPOTHERGrid};
+  long blockstart, blockend;
+  int gridid;
+
+  for (blockstart = 0; blockstart < landpixcount; blockstart += blocksize) {
+      blockend = blockstart + blocksize;
+      if (blockend > landpixcount) {
+          blockend = landpixcount;
+      }
+      generateLUHcollectionGrids(blockstart,blockend);
+      for (gridid = 0; gridid < TESTGRIDS; gridid++) {
+          memcpy(rungrids[gridid] + blockstart, *scratchgrids[gridid], (blockend - blockstart) * sizeof(float));
+      }
+  }
+
+  return 0;
+
+}
+
+int main(int narg, char **argv) {
+
+  char *gridnames[TESTGRIDS] = {"BASEFORESTTOTAL", "BASENONFORESTTOTAL", "BASECROPTOTAL", "BASEMISSING", "BASEOTHER", "BASENATVEG",
+                                "CURRFORESTTOTAL", "CURRNONFORESTTOTAL", "CURRCROPTOTAL", "CURRMISSING", "CURROTHER", "CURRNATVEG",
+                                "UNREPFOREST", "UNREPOTHER"};
+  long blocksizes[] = {KERNELBLOCKLAND, 37, 1};
+  float *scalargrids[TESTGRIDS], *rungrids[TESTGRIDS];
+  int gridid, sizeid, failures;
+
+  createtestland();
+  createtestinputs();
+  createkernelscratch();
+  printf("Testing %ld land pixels of a %d by %d region\n",landpixcount,TESTLIN,TESTPIX);
+
+  for (gridid = 0; gridid < TESTGRIDS; gridid++) {
+      scalargrids[gridid] = (float *) malloc(landpixcount * sizeof(float));
+      rungrids[gridid] = (float *) malloc(landpixcount * sizeof(float));
+  }
+  generatescalarcollection(scalargrids);
+
+  failures = 0;
+  for (sizeid = 0; sizeid < (int) (sizeof(blocksizes) / sizeof(long)); sizeid++) {
+      for (gridid = 0; gridid < TESTGRIDS; gridid++) {
+          memset(rungrids[gridid], 0xff, landpixcount * sizeof(float));
+      }
+      generaterunscollection(rungrids,blocksizes[sizeid]);
+      for (gridid = 0; gridid < TESTGRIDS; gridid++) {
+          if (memcmp(scalargrids[gridid], rungrids[gridid], landpixcount * sizeof(float)) != 0) {
+              printf("FAIL %s differs from the per pixel loop with blocks of %ld\n",gridnames[gridid],blocksizes[sizeid]);
+              failures++;
+          }
+      }
+  }
+
+  freekernelscratch();
+
+  if (failures > 0) {
+      return 1;
+  }
+
+  printf("PASS the run based collection kernels match the per pixel loop\n");
+
+  return 0;
+
+}